@@ -0,0 +1,215 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_ACKERMANN__ODOM_INTEGRATOR_HPP_
+#define VESC_ACKERMANN__ODOM_INTEGRATOR_HPP_
+
+#include <cmath>
+#include <string>
+
+namespace vesc_ackermann
+{
+
+/** Pose integration schemes, see OdomIntegrator. */
+typedef enum
+{
+  INTEGRATOR_EULER,        ///< end-of-step velocity along the start-of-step heading (legacy)
+  INTEGRATOR_TRAPEZOIDAL,  ///< average of start and end velocities in the world frame
+  INTEGRATOR_RK4,          ///< classic Runge-Kutta with linearly interpolated speed and yaw rate
+  INTEGRATOR_ARC           ///< exact constant-curvature arc with the mean speed and yaw rate
+}
+OdomIntegratorType;
+
+/** @return False if @p name is not one of "euler", "trapezoidal", "rk4" or "arc". */
+inline bool parseOdomIntegrator(const std::string & name, OdomIntegratorType * type)
+{
+  if (name == "euler") {
+    *type = INTEGRATOR_EULER;
+  } else if (name == "trapezoidal") {
+    *type = INTEGRATOR_TRAPEZOIDAL;
+  } else if (name == "rk4") {
+    *type = INTEGRATOR_RK4;
+  } else if (name == "arc") {
+    *type = INTEGRATOR_ARC;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Planar dead reckoning from speed and yaw rate samples.
+ *
+ * The heading is kept as a unit vector and advanced by small rotations whose sine and cosine are
+ * evaluated with short Taylor series, so a step costs no trigonometric calls for the yaw changes
+ * that occur between two telemetry messages. The vector is renormalized after every rotation to
+ * stop rounding errors from accumulating.
+ */
+class OdomIntegrator
+{
+public:
+  explicit OdomIntegrator(OdomIntegratorType type = INTEGRATOR_EULER)
+  : type_(type)
+  {
+    reset();
+  }
+
+  void setType(OdomIntegratorType type)
+  {
+    type_ = type;
+  }
+
+  void reset(double x = 0.0, double y = 0.0, double yaw = 0.0)
+  {
+    x_ = x;
+    y_ = y;
+    yaw_ = yaw;
+    cos_yaw_ = std::cos(yaw);
+    sin_yaw_ = std::sin(yaw);
+  }
+
+  /**
+   * Advances the pose by @p dt seconds, during which speed and yaw rate went from @p v0, @p w0
+   * to @p v1, @p w1.
+   */
+  void step(double v0, double w0, double v1, double w1, double dt)
+  {
+    switch (type_) {
+      case INTEGRATOR_EULER:
+        x_ += v1 * cos_yaw_ * dt;
+        y_ += v1 * sin_yaw_ * dt;
+        rotate(w1 * dt);
+        break;
+
+      case INTEGRATOR_TRAPEZOIDAL:
+        {
+          double c0 = cos_yaw_, s0 = sin_yaw_;
+          rotate(0.5 * (w0 + w1) * dt);
+          x_ += 0.5 * dt * (v0 * c0 + v1 * cos_yaw_);
+          y_ += 0.5 * dt * (v0 * s0 + v1 * sin_yaw_);
+        }
+        break;
+
+      case INTEGRATOR_RK4:
+        {
+          // with a linear yaw rate the heading is quadratic in time, which RK4 integrates exactly
+          double vm = 0.5 * (v0 + v1), wm = 0.5 * (w0 + w1);
+          double c2, s2, c3, s3, c4, s4;
+          rotated(0.5 * dt * w0, &c2, &s2);
+          rotated(0.5 * dt * wm, &c3, &s3);
+          rotated(dt * wm, &c4, &s4);
+          x_ += dt / 6.0 * (v0 * cos_yaw_ + 2.0 * vm * (c2 + c3) + v1 * c4);
+          y_ += dt / 6.0 * (v0 * sin_yaw_ + 2.0 * vm * (s2 + s3) + v1 * s4);
+          rotate(dt * wm);
+        }
+        break;
+
+      case INTEGRATOR_ARC:
+        arc(0.5 * (v0 + v1) * dt, 0.5 * (w0 + w1) * dt);
+        break;
+    }
+  }
+
+  /**
+   * Moves @p distance along a circular arc that turns the heading by @p yaw_change. The chord is
+   * distance * sinc(yaw_change / 2) long and points along the heading halfway through the turn.
+   */
+  void arc(double distance, double yaw_change)
+  {
+    double half = 0.5 * yaw_change;
+    double half2 = half * half;
+    double sinc = std::fabs(half) < SERIES_LIMIT ?
+      1.0 - half2 / 6.0 * (1.0 - half2 / 20.0 * (1.0 - half2 / 42.0)) :
+      std::sin(half) / half;
+    double c, s;
+    rotated(half, &c, &s);
+    x_ += distance * sinc * c;
+    y_ += distance * sinc * s;
+    rotate(yaw_change);
+  }
+
+  double x() const {return x_;}
+  double y() const {return y_;}
+  /** Accumulated yaw, not wrapped to [-pi, pi]. */
+  double yaw() const {return yaw_;}
+  double cosYaw() const {return cos_yaw_;}
+  double sinYaw() const {return sin_yaw_;}
+
+  /** z and w of the orientation quaternion, from the heading vector by the half-angle formulas. */
+  void orientation(double * qz, double * qw) const
+  {
+    if (cos_yaw_ > -0.5) {
+      *qw = std::sqrt(0.5 * (1.0 + cos_yaw_));
+      *qz = sin_yaw_ / (2.0 * *qw);
+    } else {
+      *qz = std::copysign(std::sqrt(0.5 * (1.0 - cos_yaw_)), sin_yaw_);
+      *qw = sin_yaw_ / (2.0 * *qz);
+    }
+  }
+
+private:
+  /** Rotations up to this angle use the series, whose error is about 1e-15 there. */
+  static constexpr double SERIES_LIMIT = 0.05;
+
+  /** Heading vector rotated by @p angle from the current heading. */
+  void rotated(double angle, double * c, double * s) const
+  {
+    double ca, sa;
+    if (std::fabs(angle) < SERIES_LIMIT) {
+      double a2 = angle * angle;
+      ca = 1.0 - a2 / 2.0 * (1.0 - a2 / 12.0 * (1.0 - a2 / 30.0));
+      sa = angle * (1.0 - a2 / 6.0 * (1.0 - a2 / 20.0 * (1.0 - a2 / 42.0)));
+    } else {
+      ca = std::cos(angle);
+      sa = std::sin(angle);
+    }
+    *c = cos_yaw_ * ca - sin_yaw_ * sa;
+    *s = sin_yaw_ * ca + cos_yaw_ * sa;
+  }
+
+  void rotate(double angle)
+  {
+    double c, s;
+    rotated(angle, &c, &s);
+    // one Newton step towards unit length, enough since the error is always tiny
+    double scale = 0.5 * (3.0 - (c * c + s * s));
+    cos_yaw_ = c * scale;
+    sin_yaw_ = s * scale;
+    yaw_ += angle;
+  }
+
+  OdomIntegratorType type_;
+  double x_, y_, yaw_;
+  double cos_yaw_, sin_yaw_;
+};
+
+}  // namespace vesc_ackermann
+
+#endif  // VESC_ACKERMANN__ODOM_INTEGRATOR_HPP_
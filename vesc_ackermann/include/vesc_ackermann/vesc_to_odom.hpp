@@ -36,16 +36,21 @@
 #include <memory>
 #include <string>
 
+#include <builtin_interfaces/msg/time.hpp>
 #include <nav_msgs/msg/odometry.hpp>
 #include <rclcpp/rclcpp.hpp>
 #include <std_msgs/msg/float64.hpp>
+#include <vesc_msgs/msg/vesc_imu_stamped.hpp>
 #include <vesc_msgs/msg/vesc_state_stamped.hpp>
 
+#include "vesc_ackermann/odom_integrator.hpp"
+
 namespace vesc_ackermann
 {
 
 using nav_msgs::msg::Odometry;
 using std_msgs::msg::Float64;
+using vesc_msgs::msg::VescImuStamped;
 using vesc_msgs::msg::VescStateStamped;
 
 class VescToOdom : public rclcpp::Node
@@ -64,21 +69,52 @@ private:
   double steering_to_servo_gain_, steering_to_servo_offset_;
   double wheelbase_;
   bool publish_tf_;
+  /** Integrate tachometer counts rather than the speed estimate for position */
+  bool use_tachometer_;
+  double tachometer_to_distance_gain_;  ///< meters per tachometer count
+  /** Integrate at the IMU rate with the gyro yaw rate, corrected towards the wheel heading */
+  bool use_imu_;
+  double imu_gyro_scale_;  ///< converts the VESC gyro z reading (deg/s) to rad/s
+  /** Below this frequency (Hz) the heading follows the wheels, above it the gyro; 0 is gyro only */
+  double imu_yaw_crossover_frequency_;
 
   // odometry state
-  double x_, y_, yaw_;
+  OdomIntegrator integrator_;
+  double last_speed_, last_angular_velocity_;  ///< velocities at the last state message
   Float64::SharedPtr last_servo_cmd_;  ///< Last servo position commanded value
   VescStateStamped::SharedPtr last_state_;  ///< Last received state message
+  VescImuStamped::SharedPtr last_imu_;      ///< Last received IMU message
+
+  /** Wheel speed and kinematic yaw rate from a state message, for IMU mode. */
+  struct WheelSample
+  {
+    double stamp;             ///< seconds
+    double speed;
+    double angular_velocity;  ///< from the servo command, 0 without one
+    bool kinematic;           ///< angular_velocity is known
+  };
+  WheelSample wheel_samples_[2];  ///< the previous and the last state message
+  int num_wheel_samples_;
+  double wheel_yaw_;                   ///< heading integrated from the kinematic yaw rate
+  double last_kinematic_velocity_;     ///< kinematic yaw rate at the last IMU sample
 
   // ROS services
   rclcpp::Publisher<Odometry>::SharedPtr odom_pub_;
   rclcpp::Subscription<VescStateStamped>::SharedPtr vesc_state_sub_;
   rclcpp::Subscription<Float64>::SharedPtr servo_sub_;
+  rclcpp::Subscription<VescImuStamped>::SharedPtr imu_sub_;
   std::shared_ptr<tf2_ros::TransformBroadcaster> tf_pub_;
 
   // ROS callbacks
   void vescStateCallback(const VescStateStamped::SharedPtr state);
   void servoCmdCallback(const Float64::SharedPtr servo);
+  void imuCallback(const VescImuStamped::SharedPtr imu);
+
+  /** @return The wheel sample interpolated to @p stamp, held beyond the received ones. */
+  WheelSample wheelSampleAt(double stamp) const;
+
+  void publishOdometry(
+    const builtin_interfaces::msg::Time & stamp, double speed, double angular_velocity);
 };
 
 }  // namespace vesc_ackermann
@@ -30,7 +30,9 @@
 
 #include "vesc_ackermann/vesc_to_odom.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <string>
 
 #include <geometry_msgs/msg/transform_stamped.hpp>
@@ -51,9 +53,16 @@ VescToOdom::VescToOdom(const rclcpp::NodeOptions & options)
   base_frame_("base_link"),
   use_servo_cmd_(true),
   publish_tf_(false),
-  x_(0.0),
-  y_(0.0),
-  yaw_(0.0)
+  use_tachometer_(false),
+  tachometer_to_distance_gain_(0.0),
+  use_imu_(false),
+  imu_gyro_scale_(M_PI / 180.0),
+  imu_yaw_crossover_frequency_(0.0),
+  last_speed_(0.0),
+  last_angular_velocity_(0.0),
+  num_wheel_samples_(0),
+  wheel_yaw_(0.0),
+  last_kinematic_velocity_(0.0)
 {
   // get ROS parameters
   odom_frame_ = declare_parameter("odom_frame", odom_frame_);
@@ -73,6 +82,40 @@ VescToOdom::VescToOdom(const rclcpp::NodeOptions & options)
 
   publish_tf_ = declare_parameter("publish_tf", publish_tf_);
 
+  // pose integration scheme for the speed based odometry
+  std::string integrator = declare_parameter<std::string>("odom_integrator", "euler");
+  OdomIntegratorType integrator_type;
+  if (!parseOdomIntegrator(integrator, &integrator_type)) {
+    RCLCPP_WARN(
+      get_logger(), "Unknown odom_integrator '%s', using 'euler'.", integrator.c_str());
+    integrator_type = INTEGRATOR_EULER;
+  }
+  integrator_.setType(integrator_type);
+
+  // the tachometer counts commutations, by default 6 per electrical revolution, so with the speed
+  // gain in eRPM per m/s one count is 60 / (6 * gain) meters
+  use_tachometer_ = declare_parameter("use_tachometer_to_calc_position", use_tachometer_);
+  if (use_tachometer_) {
+    double counts_per_erev = declare_parameter<double>("tachometer_counts_per_erev", 6.0);
+    tachometer_to_distance_gain_ = 60.0 / (counts_per_erev * speed_to_erpm_gain_);
+  }
+
+  // optionally integrate at the IMU rate, with yaw rate from the gyro; the driver's imu_mask must
+  // include the gyro. With the servo command, a complementary filter keeps the gyro heading from
+  // drifting away from the kinematic one.
+  use_imu_ = declare_parameter("use_imu_to_calc_angular_velocity", use_imu_);
+  if (use_imu_) {
+    imu_gyro_scale_ = declare_parameter("imu_gyro_scale", imu_gyro_scale_);
+    imu_yaw_crossover_frequency_ = std::max(
+      0.0, declare_parameter("imu_yaw_crossover_frequency", imu_yaw_crossover_frequency_));
+    if (use_tachometer_) {
+      RCLCPP_WARN(
+        get_logger(), "use_tachometer_to_calc_position is ignored when integrating at the IMU "
+        "rate, using the speed instead.");
+      use_tachometer_ = false;
+    }
+  }
+
   // create odom publisher
   odom_pub_ = create_publisher<Odometry>("odom", 10);
 
@@ -89,12 +132,17 @@ VescToOdom::VescToOdom(const rclcpp::NodeOptions & options)
     servo_sub_ = create_subscription<Float64>(
       "sensors/servo_position_command", 10, std::bind(&VescToOdom::servoCmdCallback, this, _1));
   }
+
+  if (use_imu_) {
+    imu_sub_ = create_subscription<VescImuStamped>(
+      "sensors/imu", 10, std::bind(&VescToOdom::imuCallback, this, _1));
+  }
 }
 
 void VescToOdom::vescStateCallback(const VescStateStamped::SharedPtr state)
 {
   // check that we have a last servo command if we are depending on it for angular velocity
-  if (use_servo_cmd_ && !last_servo_cmd_) {
+  if (use_servo_cmd_ && !last_servo_cmd_ && !use_imu_) {
     return;
   }
 
@@ -104,12 +152,27 @@ void VescToOdom::vescStateCallback(const VescStateStamped::SharedPtr state)
     current_speed = 0.0;
   }
   double current_steering_angle(0.0), current_angular_velocity(0.0);
-  if (use_servo_cmd_) {
+  if (use_servo_cmd_ && last_servo_cmd_) {
     current_steering_angle =
       (last_servo_cmd_->data - steering_to_servo_offset_) / steering_to_servo_gain_;
     current_angular_velocity = current_speed * tan(current_steering_angle) / wheelbase_;
   }
 
+  // in IMU mode the state only provides the wheel samples, odometry is integrated in imuCallback()
+  if (use_imu_) {
+    const WheelSample sample = {rclcpp::Time(state->header.stamp).seconds(), current_speed,
+      current_angular_velocity, use_servo_cmd_ && static_cast<bool>(last_servo_cmd_)};
+    if (num_wheel_samples_ > 0 && sample.stamp <= wheel_samples_[1].stamp) {
+      // out of order or repeated
+      return;
+    }
+    wheel_samples_[0] = num_wheel_samples_ > 0 ? wheel_samples_[1] : sample;
+    wheel_samples_[1] = sample;
+    num_wheel_samples_ = std::min(num_wheel_samples_ + 1, 2);
+    last_state_ = state;
+    return;
+  }
+
   // use current state as last state if this is our first time here
   if (!last_state_) {
     last_state_ = state;
@@ -118,33 +181,110 @@ void VescToOdom::vescStateCallback(const VescStateStamped::SharedPtr state)
   // calc elapsed time
   auto dt = rclcpp::Time(state->header.stamp) - rclcpp::Time(last_state_->header.stamp);
 
-  /** @todo could probably do better propigating odometry, e.g. trapezoidal integration */
-
-  // propigate odometry
-  double x_dot = current_speed * cos(yaw_);
-  double y_dot = current_speed * sin(yaw_);
-  x_ += x_dot * dt.seconds();
-  y_ += y_dot * dt.seconds();
-  if (use_servo_cmd_) {
-    yaw_ += current_angular_velocity * dt.seconds();
+  if (use_tachometer_) {
+    // distance from the exact tachometer delta; subtracting as unsigned and converting back is
+    // correct across an int32 wrap of the counter
+    int32_t counts = static_cast<int32_t>(
+      static_cast<uint32_t>(state->state.displacement) -
+      static_cast<uint32_t>(last_state_->state.displacement));
+    double distance = -static_cast<double>(counts) * tachometer_to_distance_gain_;
+
+    // follow the arc of constant curvature (the current steering angle) exactly
+    double curvature = use_servo_cmd_ ? tan(current_steering_angle) / wheelbase_ : 0.0;
+    integrator_.arc(distance, curvature * distance);
+  } else {
+    // propigate odometry
+    integrator_.step(
+      last_speed_, last_angular_velocity_, current_speed, current_angular_velocity, dt.seconds());
   }
 
   // save state for next time
   last_state_ = state;
+  last_speed_ = current_speed;
+  last_angular_velocity_ = current_angular_velocity;
+
+  publishOdometry(state->header.stamp, current_speed, current_angular_velocity);
+}
 
+VescToOdom::WheelSample VescToOdom::wheelSampleAt(double stamp) const
+{
+  const WheelSample & a = wheel_samples_[0];
+  const WheelSample & b = wheel_samples_[1];
+  if (stamp >= b.stamp || b.stamp <= a.stamp) {
+    return b;
+  } else if (stamp <= a.stamp) {
+    return a;
+  }
+  const double t = (stamp - a.stamp) / (b.stamp - a.stamp);
+  return WheelSample{stamp, a.speed + t * (b.speed - a.speed),
+    a.angular_velocity + t * (b.angular_velocity - a.angular_velocity),
+    a.kinematic && b.kinematic};
+}
+
+void VescToOdom::imuCallback(const VescImuStamped::SharedPtr imu)
+{
+  // the speed comes from the state messages
+  if (num_wheel_samples_ == 0) {
+    return;
+  }
+
+  const double stamp = rclcpp::Time(imu->header.stamp).seconds();
+  const double gyro_angular_velocity = imu->imu.angular_velocity.z * imu_gyro_scale_;
+  const WheelSample wheel = wheelSampleAt(stamp);
+
+  if (!last_imu_) {
+    last_imu_ = imu;
+    last_speed_ = wheel.speed;
+    last_angular_velocity_ = gyro_angular_velocity;
+    last_kinematic_velocity_ = wheel.angular_velocity;
+    wheel_yaw_ = integrator_.yaw();
+    return;
+  }
+
+  // skip samples that arrive out of order
+  const double dt = stamp - rclcpp::Time(last_imu_->header.stamp).seconds();
+  if (dt <= 0.0) {
+    return;
+  }
+
+  integrator_.step(last_speed_, last_angular_velocity_, wheel.speed, gyro_angular_velocity, dt);
+
+  // complementary filter on the heading: the gyro is fast but its heading drifts, the wheel heading
+  // has no gyro bias but lags and follows the commanded rather than the actual steering angle.
+  // High-passing the first and low-passing the second with the same first order filter amounts
+  // to pulling the gyro heading towards the wheel heading by a fraction of the difference.
+  wheel_yaw_ += 0.5 * (last_kinematic_velocity_ + wheel.angular_velocity) * dt;
+  if (wheel.kinematic && imu_yaw_crossover_frequency_ > 0.0) {
+    const double gain = 1.0 - 1.0 / (1.0 + 2.0 * M_PI * imu_yaw_crossover_frequency_ * dt);
+    integrator_.arc(0.0, gain * (wheel_yaw_ - integrator_.yaw()));
+  } else {
+    // nothing to correct with, keep the wheel heading from jumping once there is
+    wheel_yaw_ = integrator_.yaw();
+  }
+
+  last_imu_ = imu;
+  last_speed_ = wheel.speed;
+  last_angular_velocity_ = gyro_angular_velocity;
+  last_kinematic_velocity_ = wheel.angular_velocity;
+
+  publishOdometry(imu->header.stamp, wheel.speed, gyro_angular_velocity);
+}
+
+void VescToOdom::publishOdometry(
+  const builtin_interfaces::msg::Time & stamp, double speed, double angular_velocity)
+{
   // publish odometry message
   Odometry odom;
   odom.header.frame_id = odom_frame_;
-  odom.header.stamp = state->header.stamp;
+  odom.header.stamp = stamp;
   odom.child_frame_id = base_frame_;
 
   // Position
-  odom.pose.pose.position.x = x_;
-  odom.pose.pose.position.y = y_;
+  odom.pose.pose.position.x = integrator_.x();
+  odom.pose.pose.position.y = integrator_.y();
   odom.pose.pose.orientation.x = 0.0;
   odom.pose.pose.orientation.y = 0.0;
-  odom.pose.pose.orientation.z = sin(yaw_ / 2.0);
-  odom.pose.pose.orientation.w = cos(yaw_ / 2.0);
+  integrator_.orientation(&odom.pose.pose.orientation.z, &odom.pose.pose.orientation.w);
 
   // Position uncertainty
   /** @todo Think about position uncertainty, perhaps get from parameters? */
@@ -153,9 +293,9 @@ void VescToOdom::vescStateCallback(const VescStateStamped::SharedPtr state)
   odom.pose.covariance[35] = 0.4;  ///< yaw
 
   // Velocity ("in the coordinate frame given by the child_frame_id")
-  odom.twist.twist.linear.x = current_speed;
+  odom.twist.twist.linear.x = speed;
   odom.twist.twist.linear.y = 0.0;
-  odom.twist.twist.angular.z = current_angular_velocity;
+  odom.twist.twist.angular.z = angular_velocity;
 
   // Velocity uncertainty
   /** @todo Think about velocity uncertainty */
@@ -165,8 +305,8 @@ void VescToOdom::vescStateCallback(const VescStateStamped::SharedPtr state)
     tf.header.frame_id = odom_frame_;
     tf.child_frame_id = base_frame_;
     tf.header.stamp = now();
-    tf.transform.translation.x = x_;
-    tf.transform.translation.y = y_;
+    tf.transform.translation.x = integrator_.x();
+    tf.transform.translation.y = integrator_.y();
     tf.transform.translation.z = 0.0;
     tf.transform.rotation = odom.pose.pose.orientation;
 
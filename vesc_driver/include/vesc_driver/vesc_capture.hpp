@@ -0,0 +1,182 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_CAPTURE_HPP_
+#define VESC_DRIVER__VESC_CAPTURE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+namespace vesc_driver
+{
+
+/**
+ * Raw serial captures are append-only binary files. The file starts with a VescCaptureFileHeader,
+ * followed by one VescCaptureRecordHeader and its data bytes per chunk read from or written to the
+ * serial port. All integers are stored in host byte order.
+ */
+struct VescCaptureFileHeader
+{
+  char magic[8];     ///< VESC_CAPTURE_MAGIC
+  uint32_t version;  ///< VESC_CAPTURE_VERSION
+  uint32_t reserved;
+};
+
+struct VescCaptureRecordHeader
+{
+  int64_t stamp_ns;   ///< CLOCK_MONOTONIC time the chunk was read or written, in nanoseconds
+  uint32_t size;      ///< Number of data bytes following this header
+  uint8_t direction;  ///< VescCaptureDirection
+  uint8_t reserved[3];
+};
+
+static const char VESC_CAPTURE_MAGIC[8] = {'V', 'E', 'S', 'C', 'C', 'A', 'P', '\0'};
+static const uint32_t VESC_CAPTURE_VERSION = 1;
+
+typedef enum
+{
+  CAPTURE_RX = 0,  ///< bytes received from the VESC
+  CAPTURE_TX = 1   ///< bytes sent to the VESC
+}
+VescCaptureDirection;
+
+/**
+ * Appends timestamped serial chunks to a capture file. Writes are buffered and may be issued
+ * concurrently from the read thread and from senders. After the first failed write the writer
+ * drops everything else, so that the file never holds a partial record followed by more data.
+ */
+class VescCaptureWriter
+{
+public:
+  /**
+   * Creates (or truncates) the capture file at @p path and writes the file header.
+   *
+   * @throw std::runtime_error if the file cannot be opened or the header cannot be written.
+   */
+  explicit VescCaptureWriter(const std::string & path);
+  ~VescCaptureWriter();
+
+  VescCaptureWriter(const VescCaptureWriter &) = delete;
+  VescCaptureWriter & operator=(const VescCaptureWriter &) = delete;
+
+  /**
+   * Appends a chunk stamped with the current CLOCK_MONOTONIC time.
+   *
+   * @return false if this or an earlier write failed, see error().
+   */
+  bool write(VescCaptureDirection direction, const uint8_t * data, std::size_t size);
+
+  /**
+   * Appends a chunk with an explicit stamp.
+   *
+   * @return false if this or an earlier write failed, see error().
+   */
+  bool write(
+    int64_t stamp_ns, VescCaptureDirection direction, const uint8_t * data, std::size_t size);
+
+  /**
+   * Pushes buffered records to the file.
+   *
+   * @return false if this or an earlier write failed, see error().
+   */
+  bool flush();
+
+  /**
+   * Flushes and closes the file; later writes fail.
+   *
+   * @return false if this or an earlier write failed, see error().
+   */
+  bool close();
+
+  /** @return Description of the first failed write, or an empty string. */
+  std::string error() const;
+
+private:
+  /** Records the first failure, with errno. Call with mutex_ held. */
+  void fail(const char * what);
+
+  mutable std::mutex mutex_;
+  FILE * file_;
+  std::string error_;
+};
+
+/**
+ * Memory-maps a capture file and iterates over its records without copying.
+ */
+class VescCaptureReader
+{
+public:
+  struct Record
+  {
+    int64_t stamp_ns;
+    VescCaptureDirection direction;
+    const uint8_t * data;
+    std::size_t size;
+  };
+
+  /**
+   * Maps the capture file at @p path.
+   *
+   * @throw std::runtime_error if the file cannot be mapped or is not a capture file.
+   */
+  explicit VescCaptureReader(const std::string & path);
+  ~VescCaptureReader();
+
+  VescCaptureReader(const VescCaptureReader &) = delete;
+  VescCaptureReader & operator=(const VescCaptureReader &) = delete;
+
+  /**
+   * Reads the next record. Data pointers stay valid for the lifetime of the reader.
+   *
+   * @return false at the end of the file or at a truncated trailing record.
+   */
+  bool next(Record * record);
+
+  /** Restarts iteration at the first record. */
+  void rewind();
+
+  /** @return Size of the mapped file in bytes. */
+  std::size_t size() const;
+
+private:
+  const uint8_t * map_;
+  std::size_t size_;
+  std::size_t offset_;
+};
+
+/** @return The current CLOCK_MONOTONIC time in nanoseconds. */
+int64_t monotonicNanoseconds();
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_CAPTURE_HPP_
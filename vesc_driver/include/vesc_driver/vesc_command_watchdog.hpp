@@ -0,0 +1,82 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_COMMAND_WATCHDOG_HPP_
+#define VESC_DRIVER__VESC_COMMAND_WATCHDOG_HPP_
+
+#include <atomic>
+#include <cstdint>
+
+namespace vesc_driver
+{
+
+/**
+ * Tracks how long ago the last motor command arrived, against the command_timeout parameter.
+ *
+ * Commands are noted from subscription callbacks while timers query the watchdog, so those calls
+ * may run concurrently; setTimeout() may not run concurrently with anything else.
+ */
+class VescCommandWatchdog
+{
+public:
+  VescCommandWatchdog();
+
+  /** Sets the timeout in seconds, 0 disables the watchdog. */
+  void setTimeout(double timeout);
+  double timeout() const {return timeout_;}
+  bool enabled() const {return timeout_ > 0.0;}
+
+  /** Notes a motor command sent at CLOCK_MONOTONIC time @p stamp_ns. */
+  void commandReceived(int64_t stamp_ns);
+
+  /** Forgets the last command, e.g. on activation; the watchdog stays quiet until the next one. */
+  void reset();
+
+  /** @return Seconds from the last command to @p now_ns, negative if there has been none. */
+  double age(int64_t now_ns) const;
+
+  /** @return true if the watchdog is enabled and the last command is older than the timeout. */
+  bool expired(int64_t now_ns) const;
+
+  /**
+   * @return true if the VESC's own command timeout may be reset with COMM_ALIVE at @p now_ns,
+   *         i.e. the watchdog is enabled and the last command is no older than the timeout. A
+   *         keepalive sent for a stalled command source would keep the last command running.
+   */
+  bool keepaliveDue(int64_t now_ns) const;
+
+private:
+  double timeout_;
+  std::atomic<int64_t> last_command_ns_;  ///< 0 if there has been no command
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_COMMAND_WATCHDOG_HPP_
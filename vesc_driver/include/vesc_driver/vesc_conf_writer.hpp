@@ -0,0 +1,140 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_CONF_WRITER_HPP_
+#define VESC_DRIVER__VESC_CONF_WRITER_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_configuration.hpp"
+#include "vesc_driver/vesc_packet.hpp"
+
+namespace vesc_driver
+{
+
+typedef enum
+{
+  CONF_WRITE_UNCHANGED = 0,  ///< desired configuration already on the VESC, nothing was sent
+  CONF_WRITE_VERIFIED,       ///< written, and the VESC reads back exactly what was written
+  CONF_WRITE_MISMATCH,       ///< written, but the VESC reads back something else
+  CONF_WRITE_TIMEOUT,        ///< no configuration, acknowledgement or readback within the timeout
+  CONF_WRITE_REFUSED         ///< the VESC sent a layout other than the codec's, nothing was sent
+} conf_write_result_t;
+
+/** @return Printable name of @p result. */
+const char * confWriteResultString(conf_write_result_t result);
+
+/**
+ * Writes a configuration (mc_configuration or app_configuration) to a VESC with COMM_SET_MCCONF
+ * or COMM_SET_APPCONF, but only if it differs from the configuration on the VESC, and verifies it
+ * by reading it back.
+ *
+ * The writer does not own the link: packets go out through the send function, normally
+ * VescInterface::send(), and the packets received from the VESC must be passed to handlePacket().
+ * A protocol emulator can take the place of both, and may even reply from within the send
+ * function.
+ */
+template<typename Conf>
+class VescConfWriter
+{
+public:
+  typedef std::function<void (const VescPacket &)> SendFunction;
+
+  VescConfWriter(const VescConfCodec<Conf> & codec, SendFunction send);
+
+  /**
+   * Offers a packet received from the VESC to the writer.
+   *
+   * @return true if the packet was the acknowledgement or readback a write() is waiting for.
+   */
+  bool handlePacket(const VescPacket & packet);
+
+  /**
+   * Changes the fields in which @p desired differs from @p current. If there are any, the
+   * configuration is read from the VESC, the changes are applied to it and it is written unless
+   * the VESC holds them already, then read back.
+   *
+   * @p current may be a cached copy, it only decides whether there is anything to change; what is
+   * written is always based on what the VESC sends right before, and only if the VESC sends the
+   * codec's signature.
+   *
+   * Blocks for up to @p timeout for each of the read, the acknowledgement and the readback, so it
+   * must not be called from the thread that calls handlePacket(). Only one write() may run at a
+   * time.
+   *
+   * @param current Configuration the changes are made against. Must have been read by the
+   *        firmware version of the codec.
+   * @param changed If not NULL, receives the names of the fields that were written.
+   * @param readback If not NULL, receives the configuration the VESC holds once write() returns,
+   *        e.g. to update a VescConfCache. Left untouched unless the VESC sent one of the codec's
+   *        layout.
+   * @throw std::invalid_argument if @p current does not match the codec.
+   */
+  conf_write_result_t write(
+    const VescConfBlob & current, const Conf & desired, std::chrono::milliseconds timeout,
+    std::vector<std::string> * changed = NULL, VescConfBlob * readback = NULL);
+
+private:
+  typedef enum
+  {
+    STAGE_IDLE,
+    STAGE_ACK,        ///< waiting for the acknowledgement of the write
+    STAGE_ACKED,
+    STAGE_READBACK,   ///< waiting for the configuration, before or after the write
+    STAGE_READ
+  } stage_t;
+
+  /** Sets @p stage, sends @p packet and waits for @p done. @return false on timeout. */
+  bool exchange(
+    stage_t stage, const VescPacket & packet, stage_t done, std::chrono::milliseconds timeout);
+
+  const VescConfCodec<Conf> & codec_;
+  SendFunction send_;
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  stage_t stage_;
+  uint32_t read_signature_;
+  std::vector<uint8_t> read_data_;
+};
+
+typedef VescConfWriter<mc_configuration> VescMcConfWriter;
+typedef VescConfWriter<app_configuration> VescAppConfWriter;
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_CONF_WRITER_HPP_
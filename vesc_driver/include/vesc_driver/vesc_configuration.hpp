@@ -0,0 +1,203 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_CONFIGURATION_HPP_
+#define VESC_DRIVER__VESC_CONFIGURATION_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/datatypes.hpp"
+
+namespace vesc_driver
+{
+
+/** How a configuration field is held in its struct and encoded on the wire (confgenerator.c). */
+typedef enum
+{
+  CONF_FIELD_FLOAT32_AUTO,  ///< float, buffer_append_float32_auto()
+  CONF_FIELD_ENUM_U8,       ///< enum, one byte
+  CONF_FIELD_BOOL,          ///< bool, one byte
+  CONF_FIELD_INT8,          ///< int8_t, one byte
+  CONF_FIELD_UINT8,         ///< uint8_t, one byte
+  CONF_FIELD_INT_U8,        ///< int, one byte
+  CONF_FIELD_INT_I16,       ///< int, big-endian int16
+  CONF_FIELD_INT_U16,       ///< int, big-endian uint16
+  CONF_FIELD_UINT16,        ///< uint16_t, big-endian
+  CONF_FIELD_UINT32_U16,    ///< uint32_t, big-endian uint16
+  CONF_FIELD_INT32,         ///< int32_t, big-endian
+  CONF_FIELD_UINT32         ///< uint32_t, big-endian
+} conf_field_type_t;
+
+struct VescConfField
+{
+  const char * name;
+  conf_field_type_t type;
+  std::size_t offset;       ///< offsetof() the field in the configuration struct
+};
+
+/**
+ * Serialization of a configuration struct (mc_configuration or app_configuration) as one firmware
+ * release sends it in reply to COMM_GET_MCCONF or COMM_GET_APPCONF: a uint32 signature followed by
+ * the fields in a fixed order. The layout changes between releases, so codecs are looked up by
+ * firmware version, and each only accepts the signature of the layout it was written for.
+ */
+template<typename Conf>
+class VescConfCodec
+{
+public:
+  VescConfCodec(
+    int fw_major, int fw_minor, uint32_t signature, const std::vector<VescConfField> & fields);
+
+  int fwMajor() const {return fw_major_;}
+  int fwMinor() const {return fw_minor_;}
+  /** @return The signature of the layout, MCCONF_SIGNATURE or APPCONF_SIGNATURE of the firmware. */
+  uint32_t signature() const {return signature_;}
+  const std::vector<VescConfField> & fields() const {return fields_;}
+
+  /** @return Size of the serialized fields, not counting the signature. */
+  std::size_t size() const {return size_;}
+
+  /**
+   * Decodes the @p size bytes at @p data, which follow @p signature.
+   *
+   * @return false, leaving @p conf untouched, if @p signature is not signature() or @p size does
+   *         not match the layout.
+   */
+  bool decode(uint32_t signature, const uint8_t * data, std::size_t size, Conf * conf) const;
+
+  /** Encodes @p conf into the size() bytes at @p data, as they follow the signature. */
+  void encode(const Conf & conf, uint8_t * data) const;
+
+  /**
+   * @return Names of the fields that differ between @p a and @p b once encoded, so differences the
+   *         wire cannot carry, e.g. float bits lost in encoding, do not count.
+   */
+  std::vector<std::string> diff(const Conf & a, const Conf & b) const;
+
+  /** @return The field called @p name, e.g. "l_current_max" or "app_ppm_conf.hyst", or NULL. */
+  const VescConfField * field(const std::string & name) const;
+
+  /** @return The value of @p field in @p conf, converted to double. */
+  double get(const Conf & conf, const VescConfField & field) const;
+
+  /** Sets @p field in @p conf to @p value, converted to the field's type. */
+  void set(Conf * conf, const VescConfField & field, double value) const;
+
+private:
+  int fw_major_;
+  int fw_minor_;
+  uint32_t signature_;
+  std::vector<VescConfField> fields_;
+  std::size_t size_;
+};
+
+/** @return The mc_configuration codec of firmware @p fw_major.@p fw_minor, NULL if unsupported. */
+const VescConfCodec<mc_configuration> * mcConfCodec(int fw_major, int fw_minor);
+
+/** @return The app_configuration codec of firmware @p fw_major.@p fw_minor, NULL if unsupported. */
+const VescConfCodec<app_configuration> * appConfCodec(int fw_major, int fw_minor);
+
+/**
+ * @return The mc_configuration codecs of all supported releases. A release is only supported once
+ *         a reply captured from it decodes and re-encodes unchanged, see test/data.
+ */
+const std::vector<VescConfCodec<mc_configuration>> & mcConfCodecs();
+
+/** @return The app_configuration codecs of all supported releases, as for mcConfCodecs(). */
+const std::vector<VescConfCodec<app_configuration>> & appConfCodecs();
+
+/** A configuration as read from the VESC, kept undecoded so it outlives codec changes. */
+struct VescConfBlob
+{
+  int fw_major;             ///< firmware version that sent it, selects the codec
+  int fw_minor;
+  uint32_t signature;       ///< layout signature sent by the firmware
+  std::vector<uint8_t> data;  ///< serialized fields following the signature
+};
+
+/**
+ * Reads a configuration written by storeConfBlob().
+ *
+ * @return false if @p path cannot be read or holds no configuration.
+ */
+bool loadConfBlob(const std::string & path, VescConfBlob * blob);
+
+/**
+ * Writes @p blob to @p path, atomically for concurrent readers.
+ *
+ * @throw std::runtime_error if the file cannot be written.
+ */
+void storeConfBlob(const std::string & path, const VescConfBlob & blob);
+
+/**
+ * Configurations read from VESCs, stored in a directory as one file per VESC UUID and kind, e.g.
+ * <uuid>.mcconf, so they need not be transferred again on every start.
+ */
+class VescConfCache
+{
+public:
+  explicit VescConfCache(const std::string & directory);
+
+  /** @return true and the stored configuration in @p blob if there is a readable one. */
+  bool load(const std::string & uuid, const std::string & kind, VescConfBlob * blob) const;
+
+  /**
+   * Replaces the stored configuration, atomically for concurrent readers.
+   *
+   * @throw std::runtime_error if the file cannot be written.
+   */
+  void store(const std::string & uuid, const std::string & kind, const VescConfBlob & blob) const;
+
+private:
+  std::string path(const std::string & uuid, const std::string & kind) const;
+
+  std::string directory_;
+};
+
+struct VescConfCacheHeader
+{
+  char magic[8];            ///< VESC_CONF_CACHE_MAGIC
+  uint32_t version;         ///< VESC_CONF_CACHE_VERSION
+  int32_t fw_major;
+  int32_t fw_minor;
+  uint32_t signature;
+  uint32_t size;            ///< number of data bytes following the header
+  uint32_t reserved;
+};
+
+static const char VESC_CONF_CACHE_MAGIC[8] = {'V', 'E', 'S', 'C', 'C', 'F', 'G', '\0'};
+static const uint32_t VESC_CONF_CACHE_VERSION = 1;
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_CONFIGURATION_HPP_
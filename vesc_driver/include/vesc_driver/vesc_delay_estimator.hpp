@@ -0,0 +1,99 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_DELAY_ESTIMATOR_HPP_
+#define VESC_DRIVER__VESC_DELAY_ESTIMATOR_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+namespace vesc_driver
+{
+
+/**
+ * Estimates how long before its response was read the VESC sampled the values in it, from the
+ * round trip times of requests, in the manner of an NTP clock filter followed by a Kalman filter.
+ *
+ * The VESC has no clock to exchange, so there is no offset to estimate; the model is that it
+ * samples when it handles a request, answers straight away, and that the link is symmetric. The
+ * reply delay is then half the round trip without queueing. Each half round trip first goes
+ * through a minimum filter over the last few exchanges, which discards most of the queueing on
+ * the host (scheduling, transmit batching, USB polling) like NTP's clock filter does, and the
+ * result is tracked with a random walk Kalman filter so the estimate follows slow link changes.
+ * Jitter is the RMS deviation of the raw half round trips from the estimate.
+ */
+class VescDelayEstimator
+{
+public:
+  struct Estimate
+  {
+    uint64_t num_samples;  ///< number of round trips seen
+    double delay;          ///< estimated reply delay, in seconds
+    double uncertainty;    ///< standard deviation of the delay estimate, in seconds
+    double jitter;         ///< RMS deviation of half round trips from the estimate, in seconds
+  };
+
+  /**
+   * @param filter_size Number of recent exchanges the minimum filter picks from.
+   * @param process_noise How fast the true delay is expected to wander, in s^2 per second.
+   */
+  explicit VescDelayEstimator(std::size_t filter_size = 8, double process_noise = 1e-9);
+
+  /** Adds a round trip of @p rtt_ns whose response was read at @p stamp_ns. */
+  void update(int64_t stamp_ns, int64_t rtt_ns);
+
+  /**
+   * @return Estimated CLOCK_MONOTONIC time at which the VESC sampled a packet read at
+   *         @p rx_stamp_ns, or @p rx_stamp_ns itself before the first round trip.
+   */
+  int64_t sampleStamp(int64_t rx_stamp_ns) const;
+
+  Estimate estimate() const;
+
+  /** Forgets all round trips, e.g. after reconnecting. */
+  void reset();
+
+private:
+  mutable std::mutex mutex_;
+  std::size_t filter_size_;
+  double process_noise_;
+  std::deque<double> recent_;  ///< half round trips of the last exchanges, in seconds
+  uint64_t num_samples_;
+  int64_t last_stamp_ns_;
+  double delay_;
+  double variance_;
+  double jitter2_;
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_DELAY_ESTIMATOR_HPP_
@@ -0,0 +1,108 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_DEVICE_MONITOR_HPP_
+#define VESC_DRIVER__VESC_DEVICE_MONITOR_HPP_
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct udev;
+struct udev_device;
+struct udev_monitor;
+
+namespace vesc_driver
+{
+
+/**
+ * Watches udev for serial ports of USB devices with a given vendor and product ID, by default the
+ * ones 99-vesc6.rules matches, and reports each one that appears. Ports are reported on threads of
+ * their own, so a port that is slow to answer does not hold up the others.
+ */
+class VescDeviceMonitor
+{
+public:
+  /**
+   * Called with the device node, e.g. /dev/ttyACM0, of a matching port. Calls for different ports
+   * run concurrently; a port is not reported again while a call for it is still running.
+   */
+  typedef std::function<void (const std::string &)> DeviceAddedFunction;
+
+  /**
+   * Starts listening for hotplug events. Devices present already are only reported by rescan().
+   *
+   * @throw std::runtime_error if the udev monitor cannot be set up.
+   */
+  explicit VescDeviceMonitor(
+    const DeviceAddedFunction & device_added,
+    const std::string & vendor_id = "0483",
+    const std::string & product_id = "5740");
+  ~VescDeviceMonitor();
+
+  VescDeviceMonitor(const VescDeviceMonitor &) = delete;
+  VescDeviceMonitor & operator=(const VescDeviceMonitor &) = delete;
+
+  /** Asks the monitor thread to report every matching port that is currently present. */
+  void rescan();
+
+private:
+  void monitorThread();
+  bool matches(udev_device * device) const;
+  std::vector<std::string> presentDevices() const;
+  /** Hands @p port to a thread of its own; on the monitor thread. */
+  void report(const std::string & port);
+
+  /** A device_added_ call in progress. */
+  struct Probe
+  {
+    std::string port;
+    std::thread thread;
+    bool done;                          ///< the call has returned, guarded by probes_mutex_
+  };
+
+  DeviceAddedFunction device_added_;
+  std::string vendor_id_;
+  std::string product_id_;
+  udev * udev_;
+  udev_monitor * monitor_;
+  int wake_pipe_[2];                    ///< 'r' requests a rescan, 'q' stops the thread
+  std::unique_ptr<std::thread> thread_;
+  std::mutex probes_mutex_;
+  std::list<Probe> probes_;             ///< started by the monitor thread, which reaps them
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_DEVICE_MONITOR_HPP_
@@ -18,10 +18,14 @@
 #define VESC_DRIVER__VESC_DEVICE_UUID_LOOKUP_HPP_
 
 
+#include <chrono>
+#include <condition_variable>
 #include <string>
 #include <memory>
+#include <mutex>
 
 #include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_identity_cache.hpp"
 #include "vesc_driver/vesc_interface.hpp"
 #include "vesc_driver/vesc_packet.hpp"
 
@@ -31,14 +35,51 @@ namespace vesc_driver
 class VescDeviceLookup
 {
 public:
-  explicit VescDeviceLookup(std::string device);
+  /**
+   * Opens @p device and requests its firmware version, which carries the UUID.
+   *
+   * If @p cache has an entry for the device's USB serial number and path, the lookup is answered
+   * from it at once, and the request only re-validates the entry in the background: a reply that
+   * contradicts it replaces it, which also stops the cache from trusting a USB serial number that
+   * comes with two UUIDs. A port that cannot be opened, e.g. because a driver holds it, leaves the
+   * entry unchecked. Otherwise the reply answers the lookup and is stored in @p cache.
+   *
+   * @param validation_timeout How long after construction the destructor waits for the reply
+   *        re-validating a cached answer.
+   */
+  explicit VescDeviceLookup(
+    std::string device,
+    std::shared_ptr<VescIdentityCache> cache = nullptr,
+    std::chrono::milliseconds validation_timeout = std::chrono::milliseconds(1000));
+
+  /** Gives the re-validation of a cached answer until the validation timeout, then closes. */
+  ~VescDeviceLookup();
 
   const char * deviceUUID() const;
   const char * version() const;
   const char * hwname() const;
+  /** @return Why the lookup failed, empty if it has not. */
+  const char * error() const;
+  /** @return true if the lookup was answered from the identity cache. */
+  bool fromCache() const;
+  /**
+   * Closes the port at once, abandoning the re-validation of a cached answer, e.g. because the
+   * caller is about to open the port and check the identity itself.
+   */
   void close();
   bool isReady();
 
+  /**
+   * Blocks until the VESC has answered, repeating the request every @p retry_period in case it
+   * was lost, e.g. while the VESC was still booting.
+   *
+   * @return true if the UUID is known, false if the port could not be opened or @p timeout
+   *         expired first.
+   */
+  bool waitReady(
+    std::chrono::milliseconds timeout,
+    std::chrono::milliseconds retry_period = std::chrono::milliseconds(100));
+
 private:
   std::string device_;
   std::string uuid_;
@@ -46,12 +87,28 @@ private:
   std::string hwname_;
   std::string error_;
   bool ready_;
+  bool failed_;                         ///< the port could not be opened
+  bool from_cache_;
+  bool replied_;                        ///< the VESC answered the request
+  bool validating_;                     ///< a cached answer awaits the VESC's reply
+
+  std::shared_ptr<VescIdentityCache> cache_;
+  std::string usb_serial_;
+  VescIdentity cached_identity_;        ///< the cache entry that answered, if from_cache_
+  std::chrono::steady_clock::time_point validation_deadline_;
+
+  // the reply arrives on the interface's read thread
+  mutable std::mutex mutex_;
+  std::condition_variable ready_condition_;
 
 private:
   // interface to the VESC
   VescInterface vesc_;
+  /** Waits until the VESC replies or @p deadline, repeating the request every @p retry_period. */
+  void awaitReply(
+    std::chrono::steady_clock::time_point deadline, std::chrono::milliseconds retry_period);
   void vescPacketCallback(const std::shared_ptr<VescPacket const> & packet);
-  void vescErrorCallback(const std::string & error);
+  void vescErrorCallback(VescErrorCode error, std::size_t num_bytes);
 
   static std::string decode_uuid(const uint8_t * uuid)
   {
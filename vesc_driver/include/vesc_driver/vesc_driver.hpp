@@ -31,11 +31,23 @@
 #ifndef VESC_DRIVER__VESC_DRIVER_HPP_
 #define VESC_DRIVER__VESC_DRIVER_HPP_
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <experimental/optional>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
+#include <ackermann_msgs/msg/ackermann_drive_stamped.hpp>
+#include <diagnostic_updater/diagnostic_updater.hpp>
+#include <diagnostic_updater/update_functions.hpp>
 #include <rclcpp/rclcpp.hpp>
+#include <rclcpp/version.h>
+#include <rclcpp_lifecycle/lifecycle_node.hpp>
 #include <sensor_msgs/msg/imu.hpp>
 #include <std_msgs/msg/float64.hpp>
 #include <vesc_msgs/msg/vesc_state.hpp>
@@ -43,45 +55,111 @@
 #include <vesc_msgs/msg/vesc_imu.hpp>
 #include <vesc_msgs/msg/vesc_imu_stamped.hpp>
 
+#include "vesc_driver/vesc_command_watchdog.hpp"
+#include "vesc_driver/vesc_configuration.hpp"
+#include "vesc_driver/vesc_device_monitor.hpp"
+#include "vesc_driver/vesc_identity_cache.hpp"
 #include "vesc_driver/vesc_interface.hpp"
 #include "vesc_driver/vesc_packet.hpp"
 
 namespace vesc_driver
 {
 
+using ackermann_msgs::msg::AckermannDriveStamped;
 using std_msgs::msg::Float64;
 using vesc_msgs::msg::VescState;
 using vesc_msgs::msg::VescStateStamped;
 using vesc_msgs::msg::VescImuStamped;
 using sensor_msgs::msg::Imu;
 
+/**
+ * Managed (lifecycle) node: configure opens the serial port and creates the publishers and
+ * subscriptions, activate starts polling, deactivate stops it and cleanup closes the port again.
+ * With the autostart parameter set the node configures and activates itself.
+ */
 class VescDriver
-  : public rclcpp::Node
+  : public rclcpp_lifecycle::LifecycleNode
 {
 public:
+  using CallbackReturn = rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn;
+
   explicit VescDriver(const rclcpp::NodeOptions & options);
 
+  CallbackReturn on_configure(const rclcpp_lifecycle::State & state) override;
+  CallbackReturn on_activate(const rclcpp_lifecycle::State & state) override;
+  CallbackReturn on_deactivate(const rclcpp_lifecycle::State & state) override;
+  CallbackReturn on_cleanup(const rclcpp_lifecycle::State & state) override;
+  CallbackReturn on_shutdown(const rclcpp_lifecycle::State & state) override;
+
 private:
   // interface to the VESC
   VescInterface vesc_;
   void vescPacketCallback(const std::shared_ptr<VescPacket const> & packet);
-  void vescErrorCallback(const std::string & error);
 
-  // limits on VESC commands
+  // limits on VESC commands, reconfigurable at runtime through the <name>_min and <name>_max
+  // parameters
   struct CommandLimit
   {
     CommandLimit(
-      rclcpp::Node * node_ptr,
+      rclcpp_lifecycle::LifecycleNode * node_ptr,
       const std::string & str,
       const std::experimental::optional<double> & min_lower = std::experimental::optional<double>(),
       const std::experimental::optional<double> & max_upper =
       std::experimental::optional<double>());
     double clip(double value);
-    rclcpp::Node * node_ptr;
+
+    /**
+     * Check any <name>_min and <name>_max values among @p parameters without applying them. They
+     * must be finite numbers within the feasible range, with the minimum at most the maximum.
+     *
+     * @return An empty string if the values are acceptable, otherwise why they are not.
+     */
+    std::string validate(const std::vector<rclcpp::Parameter> & parameters);
+
+    /**
+     * Apply any <name>_min and <name>_max values among @p parameters, which validate() accepted.
+     * Safe to call concurrently with clip().
+     */
+    void update(const std::vector<rclcpp::Parameter> & parameters);
+
+    /**
+     * Narrow the feasible range to the limits the VESC itself is configured with, replacing any
+     * earlier device range, and re-apply the requested limits. Safe to call concurrently with
+     * clip().
+     */
+    void setDeviceRange(double lower, double upper);
+
+    rclcpp_lifecycle::LifecycleNode * node_ptr;
     rclcpp::Logger logger;
+    rclcpp::Clock::SharedPtr clock;       ///< for throttled logging
     std::string name;
-    std::experimental::optional<double> lower;
-    std::experimental::optional<double> upper;
+    std::experimental::optional<double> min_lower;
+    std::experimental::optional<double> max_upper;
+
+private:
+    /** Immutable bounds, replaced as a whole so clip() always sees a consistent pair. */
+    struct Bounds
+    {
+      double lower;
+      double upper;
+    };
+
+    /** Validate the requested limits against the feasible range and publish them. */
+    void setBounds(double param_min, double param_max);
+
+    std::atomic<const Bounds *> bounds_;  ///< current snapshot, read without locking by clip()
+    std::atomic<int> readers_;            ///< number of clip() calls reading a snapshot
+    std::mutex update_mutex_;             ///< serializes updates
+    double param_min_;                    ///< last requested minimum, guarded by update_mutex_
+    double param_max_;                    ///< last requested maximum, guarded by update_mutex_
+    std::experimental::optional<double> device_lower_;  ///< guarded by update_mutex_
+    std::experimental::optional<double> device_upper_;  ///< guarded by update_mutex_
+    std::unique_ptr<const Bounds> current_;  ///< owns bounds_, guarded by update_mutex_
+    /**
+     * Replaced snapshots a clip() call may still be reading, guarded by update_mutex_. They are
+     * freed by the first update that finds no clip() call running.
+     */
+    std::vector<std::unique_ptr<const Bounds>> retired_;
   };
 
   CommandLimit duty_cycle_limit_;
@@ -92,31 +170,140 @@ private:
   CommandLimit servo_limit_;
 
   // ROS services
-  rclcpp::Publisher<VescStateStamped>::SharedPtr state_pub_;
-  rclcpp::Publisher<VescImuStamped>::SharedPtr imu_pub_;
-  rclcpp::Publisher<Imu>::SharedPtr imu_std_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<VescStateStamped>::SharedPtr state_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<VescImuStamped>::SharedPtr imu_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<Imu>::SharedPtr imu_std_pub_;
 
-  rclcpp::Publisher<Float64>::SharedPtr servo_sensor_pub_;
+  rclcpp_lifecycle::LifecyclePublisher<Float64>::SharedPtr servo_sensor_pub_;
   rclcpp::SubscriptionBase::SharedPtr duty_cycle_sub_;
   rclcpp::SubscriptionBase::SharedPtr current_sub_;
   rclcpp::SubscriptionBase::SharedPtr brake_sub_;
   rclcpp::SubscriptionBase::SharedPtr speed_sub_;
   rclcpp::SubscriptionBase::SharedPtr position_sub_;
   rclcpp::SubscriptionBase::SharedPtr servo_sub_;
+  rclcpp::SubscriptionBase::SharedPtr ackermann_sub_;
   rclcpp::TimerBase::SharedPtr timer_;
+  rclcpp::TimerBase::SharedPtr error_report_timer_;
+  rclcpp::TimerBase::SharedPtr keepalive_timer_;
+  rclcpp::TimerBase::SharedPtr handshake_timer_;
+  rclcpp::TimerBase::SharedPtr autostart_timer_;
+  rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr parameters_callback_handle_;
+#if RCLCPP_VERSION_GTE(21, 0, 0)
+  rclcpp::node_interfaces::PostSetParametersCallbackHandle::SharedPtr
+    parameters_set_callback_handle_;
+#endif
 
   // driver modes (possible states)
   typedef enum
   {
+    MODE_INACTIVE,
     MODE_INITIALIZING,
-    MODE_OPERATING
+    MODE_OPERATING,
+    MODE_RECONNECTING
   }
   driver_mode_t;
 
+  // commands kept while the handshake is in progress, the latest of each kind
+  typedef enum
+  {
+    COMMAND_MOTOR,
+    COMMAND_SERVO,
+    NUM_COMMAND_SLOTS
+  }
+  command_slot_t;
+
+  struct PendingCommand
+  {
+    command_slot_t slot;
+    int64_t stamp_ns;                   ///< monotonic time the command was received
+    std::function<void()> send;         ///< empty if no command is pending
+  };
+
   // other variables
-  driver_mode_t driver_mode_;           ///< driver state machine mode (state)
-  int fw_version_major_;                ///< firmware major version reported by vesc
-  int fw_version_minor_;                ///< firmware minor version reported by vesc
+  std::atomic<driver_mode_t> driver_mode_;  ///< driver state machine mode (state)
+  bool buffer_commands_;                ///< keep commands received during the handshake
+  std::mutex pending_commands_mutex_;   ///< guards pending_commands_ and leaving INITIALIZING
+  std::array<PendingCommand, NUM_COMMAND_SLOTS> pending_commands_;
+  // written by the read thread, read by diagnostics
+  std::atomic<int> fw_version_major_;   ///< firmware major version reported by vesc
+  std::atomic<int> fw_version_minor_;   ///< firmware minor version reported by vesc
+  uint16_t imu_mask_;                   ///< IMU fields polled from the vesc, see VescImuMask
+  bool stamp_sample_time_;              ///< stamp telemetry with the estimated sample time
+  VescErrorCounts last_error_counts_;   ///< serial error counters at the last error report
+
+  // conversion of ackermann commands, same parameters as vesc_ackermann's ackermann_to_vesc
+  double speed_to_erpm_gain_;
+  double speed_to_erpm_offset_;
+  double steering_to_servo_gain_;
+  double steering_to_servo_offset_;
+
+  // reconnection after the serial link fails
+  std::string port_;                    ///< serial port opened on configure
+  bool reconnect_;                      ///< reopen the port on failure rather than unconfiguring
+  double reconnect_initial_delay_;      ///< seconds before the first reopen attempt
+  double reconnect_max_delay_;          ///< upper bound on the doubling delay between attempts
+  double reconnect_delay_;              ///< delay before the next attempt
+  bool verify_uuid_;                    ///< only resume with the VESC seen at the first handshake
+  std::array<uint8_t, 12> device_uuid_;  ///< UUID from the first handshake, read thread only
+  bool have_device_uuid_;               ///< device_uuid_ is set, read thread only
+  std::atomic<bool> uuid_mismatch_;     ///< a different VESC answered the handshake
+  std::atomic<bool> reconnect_pending_;  ///< handshake after a reconnect not yet complete
+  std::chrono::steady_clock::time_point link_lost_time_;
+  std::chrono::steady_clock::time_point next_reconnect_time_;
+  std::atomic<uint64_t> num_reconnects_;
+  std::atomic<int64_t> last_reconnect_latency_ns_;  ///< link loss to handshake, -1 if none yet
+
+  // identity of the VESC on port_ remembered across runs, see VescIdentityCache
+  std::shared_ptr<VescIdentityCache> identity_cache_;
+  std::string usb_serial_;              ///< USB serial number of port_'s device, cache key
+  VescIdentity cached_identity_;        ///< cache entry for port_, read thread only once active
+  bool have_cached_identity_;           ///< cached_identity_ is set
+  /** Hold commands until the version reply confirms cached_identity_, then send them at once. */
+  std::atomic<bool> confirm_cached_identity_;
+
+  // attaching to a VESC by UUID rather than by port, wherever it is plugged in
+  std::string uuid_;                    ///< UUID to attach to, empty to use the port parameter
+  double uuid_lookup_timeout_;          ///< seconds a port may take to answer the UUID lookup
+  std::unique_ptr<VescDeviceMonitor> device_monitor_;
+  std::atomic<bool> searching_;         ///< the monitor probes the ports that appear
+  std::mutex found_port_mutex_;
+  std::condition_variable found_port_condition_;
+  std::string found_port_;              ///< port on which uuid_ answered, not yet connected
+
+  // motor configuration (COMM_GET_MCCONF) of the connected VESC, kept on disk by UUID
+  bool read_mcconf_;                    ///< read the configuration of each VESC connected to
+  bool refresh_mcconf_;                 ///< read it from the VESC even if it is on disk
+  bool use_mcconf_limits_;              ///< narrow the command limits to the configured ones
+  std::unique_ptr<VescConfCache> conf_cache_;  ///< NULL if configurations are not kept on disk
+  VescIdentity vesc_identity_;          ///< VESC that answered the handshake, read thread only
+  std::mutex mcconf_mutex_;             ///< guards the four members below
+  mc_configuration mcconf_;
+  std::string mcconf_uuid_;             ///< VESC mcconf_ belongs to, empty if none
+  int mcconf_fw_major_;                 ///< firmware version mcconf_ was decoded for
+  int mcconf_fw_minor_;
+  std::atomic<bool> mcconf_from_disk_;  ///< mcconf_ was loaded from conf_cache_
+  std::atomic<bool> mcconf_wanted_;     ///< request the configuration until it arrives
+  std::atomic<bool> mcconf_changed_;    ///< mcconf_ is to be applied on the timer
+  std::chrono::steady_clock::time_point next_mcconf_request_;
+
+  // motor command watchdog
+  VescCommandWatchdog command_watchdog_;  ///< command_timeout and the last motor command
+  double timeout_brake_current_;        ///< brake current sent on timeout, 0 releases the motor
+  std::atomic<bool> command_timed_out_;         ///< safe command is being sent
+  std::atomic<uint64_t> num_command_timeouts_;  ///< times the command deadline was missed
+  std::atomic<uint64_t> num_stale_commands_;    ///< stamped commands dropped as too old
+
+  // health reporting on /diagnostics
+  diagnostic_updater::Updater updater_;
+  double min_poll_frequency_;
+  double max_poll_frequency_;
+  std::unique_ptr<diagnostic_updater::FrequencyStatus> state_frequency_;
+  std::unique_ptr<diagnostic_updater::FrequencyStatus> imu_frequency_;
+  std::atomic<int> fault_code_;             ///< last fault code reported by vesc, -1 if none yet
+  VescErrorCounts last_diagnostic_error_counts_;
+  std::chrono::steady_clock::time_point last_diagnostic_time_;
+  void linkDiagnostics(diagnostic_updater::DiagnosticStatusWrapper & status);
+  void controllerDiagnostics(diagnostic_updater::DiagnosticStatusWrapper & status);
 
   // ROS callbacks
   void brakeCallback(const Float64::SharedPtr brake);
@@ -125,7 +312,73 @@ private:
   void positionCallback(const Float64::SharedPtr position);
   void servoCallback(const Float64::SharedPtr servo);
   void speedCallback(const Float64::SharedPtr speed);
+  void ackermannCmdCallback(const AckermannDriveStamped::SharedPtr cmd);
   void timerCallback();
+  void errorReportCallback();
+  void reportRecordingError();
+  void keepaliveCallback();
+  void handshakeCallback();
+
+  /** Switch to OPERATING and send the commands kept during the handshake; on the read thread. */
+  void handshakeComplete();
+  void updateIdentityCache(const VescIdentity & identity);
+  /** @return true if @p identity is the one in cached_identity_. */
+  bool isCachedIdentity(const VescIdentity & identity) const;
+  /** Take the connected VESC's configuration from memory or disk, or else request it. */
+  void loadMcConf();
+  /** Decode and keep a configuration read from the VESC; called on the read thread. */
+  void mcConfReceived(const VescPacketMcConf & packet);
+  /** Keep @p conf as the configuration of the connected VESC and have it applied. */
+  void setMcConf(const mc_configuration & conf, bool from_disk);
+  /** Apply the configuration to the command limits and gains; called from timerCallback(). */
+  void applyMcConf();
+  /** Drop commands kept during a handshake that will not complete. */
+  void discardPendingCommands();
+
+  /**
+   * Send a command through @p send in OPERATING mode. During the handshake the command instead
+   * replaces any earlier one in @p slot if buffer_commands_during_init is set, and is sent once
+   * the handshake completes.
+   */
+  template<typename SendFunction>
+  void dispatchCommand(command_slot_t slot, SendFunction && send);
+
+  /** Close the failed port and start reopening it with exponential backoff. */
+  void linkLost();
+  /** Reopen the port once the backoff delay has passed; called from timerCallback(). */
+  void reconnect();
+  /** Have the device monitor look for the VESC with uuid_, among present and new ports. */
+  void searchDevice();
+  /** Called on the device monitor thread when a candidate port appears; probes its UUID. */
+  void deviceAdded(const std::string & port);
+
+  /**
+   * Call @p send, which writes to the VESC, logging rather than propagating a failed write. The
+   * failure also marks the link down, which timerCallback() then handles.
+   */
+  template<typename SendFunction>
+  void trySend(SendFunction && send);
+
+  /** Stop polling, close the serial port and drop the publishers and subscriptions. */
+  void releaseResources();
+  /** Reject parameter changes the driver cannot apply, see CommandLimit::validate(). */
+  rcl_interfaces::msg::SetParametersResult parametersCallback(
+    const std::vector<rclcpp::Parameter> & parameters);
+  /** Apply parameter changes once they are set. */
+  void parametersSetCallback(const std::vector<rclcpp::Parameter> & parameters);
+
+  /** Record that a motor command was received, restarting the command deadline. */
+  void motorCommandReceived();
+  /** Check the command deadline and send the safe command if it passed; call in OPERATING mode. */
+  void checkCommandDeadline();
+  /** @return true if a command stamped @p stamp is already older than command_timeout. */
+  bool commandIsStale(const rclcpp::Time & stamp);
+
+  /**
+   * @return ROS time at which @p packet was received, see VescFrame::rxStamp(), or at which its
+   *         values were sampled if stamp_sample_time is set.
+   */
+  rclcpp::Time packetStamp(const VescPacket & packet);
 };
 
 }  // namespace vesc_driver
@@ -0,0 +1,108 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#undef TRACEPOINT_PROVIDER
+#define TRACEPOINT_PROVIDER vesc_driver
+
+#undef TRACEPOINT_INCLUDE
+#define TRACEPOINT_INCLUDE "vesc_driver/vesc_driver_tp.h"
+
+#if !defined(VESC_DRIVER__VESC_DRIVER_TP_H_) || defined(TRACEPOINT_HEADER_MULTI_READ)
+#define VESC_DRIVER__VESC_DRIVER_TP_H_
+
+#include <lttng/tracepoint.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* a chunk of bytes was read from the serial port */
+TRACEPOINT_EVENT(
+  vesc_driver, rx_chunk,
+  TP_ARGS(uint64_t, chunk_seq, size_t, size),
+  TP_FIELDS(
+    ctf_integer(uint64_t, chunk_seq, chunk_seq)
+    ctf_integer(size_t, size, size)))
+
+/* the framer found a valid frame and the factory created its packet */
+TRACEPOINT_EVENT(
+  vesc_driver, packet_created,
+  TP_ARGS(uint64_t, frame_seq, int, payload_id, size_t, size),
+  TP_FIELDS(
+    ctf_integer(uint64_t, frame_seq, frame_seq)
+    ctf_integer(int, payload_id, payload_id)
+    ctf_integer(size_t, size, size)))
+
+/* the packet handler (e.g. VescDriver::vescPacketCallback) is about to be called */
+TRACEPOINT_EVENT(
+  vesc_driver, packet_callback_begin,
+  TP_ARGS(uint64_t, frame_seq),
+  TP_FIELDS(ctf_integer(uint64_t, frame_seq, frame_seq)))
+
+/* a message built from the packet was handed to the middleware */
+TRACEPOINT_EVENT(
+  vesc_driver, packet_published,
+  TP_ARGS(uint64_t, frame_seq, const char *, topic),
+  TP_FIELDS(
+    ctf_integer(uint64_t, frame_seq, frame_seq)
+    ctf_string(topic, topic)))
+
+/* the packet handler returned */
+TRACEPOINT_EVENT(
+  vesc_driver, packet_callback_end,
+  TP_ARGS(uint64_t, frame_seq),
+  TP_FIELDS(ctf_integer(uint64_t, frame_seq, frame_seq)))
+
+/* a command message was received; the next tx_enqueue on the same thread carries it */
+TRACEPOINT_EVENT(
+  vesc_driver, command_received,
+  TP_ARGS(const char *, topic, double, value),
+  TP_FIELDS(
+    ctf_string(topic, topic)
+    ctf_float(double, value, value)))
+
+/* a frame was queued for transmission */
+TRACEPOINT_EVENT(
+  vesc_driver, tx_enqueue,
+  TP_ARGS(uint64_t, tx_seq, int, payload_id, size_t, size),
+  TP_FIELDS(
+    ctf_integer(uint64_t, tx_seq, tx_seq)
+    ctf_integer(int, payload_id, payload_id)
+    ctf_integer(size_t, size, size)))
+
+/* frames first_seq to last_seq were handed to the serial port in one write */
+TRACEPOINT_EVENT(
+  vesc_driver, tx_write,
+  TP_ARGS(uint64_t, first_seq, uint64_t, last_seq, size_t, size),
+  TP_FIELDS(
+    ctf_integer(uint64_t, first_seq, first_seq)
+    ctf_integer(uint64_t, last_seq, last_seq)
+    ctf_integer(size_t, size, size)))
+
+#endif  /* VESC_DRIVER__VESC_DRIVER_TP_H_ */
+
+#include <lttng/tracepoint-event.h>
@@ -0,0 +1,103 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_ERROR_HPP_
+#define VESC_DRIVER__VESC_ERROR_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace vesc_driver
+{
+
+/** Reasons for discarding data received from the VESC. */
+typedef enum
+{
+  VESC_ERROR_INCOMPLETE_FRAME = 0,  ///< buffer does not contain a complete frame
+  VESC_ERROR_NO_START_OF_FRAME,     ///< buffer does not begin with a start-of-frame character
+  VESC_ERROR_INVALID_LENGTH,        ///< payload length exceeds VESC_MAX_PAYLOAD_SIZE
+  VESC_ERROR_INVALID_END_OF_FRAME,  ///< end-of-frame character is missing
+  VESC_ERROR_INVALID_CHECKSUM,      ///< CRC mismatch
+  VESC_ERROR_UNKNOWN_PAYLOAD,       ///< no packet type registered for the payload id
+  VESC_ERROR_EMPTY_PAYLOAD,         ///< frame does not have a payload
+  VESC_ERROR_OUT_OF_SYNC,           ///< bytes discarded while resynchronizing
+  VESC_ERROR_NUM_CODES
+}
+VescErrorCode;
+
+/** @return A short human readable description of @p code. */
+const char * vescErrorString(VescErrorCode code);
+
+/** Plain snapshot of VescErrorCounters. */
+struct VescErrorCounts
+{
+  uint64_t events[VESC_ERROR_NUM_CODES];  ///< number of times each error occurred
+  uint64_t bytes[VESC_ERROR_NUM_CODES];   ///< number of bytes discarded for each error
+
+  /** @return Total number of errors of all codes. */
+  uint64_t total() const;
+
+  /** @return Per-code difference from an @p earlier snapshot. */
+  VescErrorCounts operator-(const VescErrorCounts & earlier) const;
+
+  /**
+   * Formats the non-zero counters, e.g. "3 invalid checksum, 2 out-of-sync (120 bytes)". This is
+   * the only place error strings are built, so call it at report time only.
+   */
+  std::string toString() const;
+};
+
+/**
+ * Per-code error counters. add() is wait-free and may be called from the read thread while other
+ * threads take snapshots.
+ */
+class VescErrorCounters
+{
+public:
+  VescErrorCounters();
+
+  void add(VescErrorCode code, std::size_t num_bytes)
+  {
+    events_[code].fetch_add(1, std::memory_order_relaxed);
+    bytes_[code].fetch_add(num_bytes, std::memory_order_relaxed);
+  }
+
+  VescErrorCounts snapshot() const;
+
+private:
+  std::atomic<uint64_t> events_[VESC_ERROR_NUM_CODES];
+  std::atomic<uint64_t> bytes_[VESC_ERROR_NUM_CODES];
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_ERROR_HPP_
@@ -0,0 +1,62 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_FLOAT_DECODE_HPP_
+#define VESC_DRIVER__VESC_FLOAT_DECODE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vesc_driver
+{
+
+/**
+ * Decodes one float32_auto value (buffer_get_float32_auto() in the VESC firmware) from its bit
+ * pattern in host byte order.
+ *
+ * The encoding is the IEEE-754 single precision layout, except that values with a zero exponent
+ * are scaled as if they were normal. The result is identical to the firmware's frexp/ldexpf based
+ * decoder for all 2^32 inputs, including the reserved exponent 255 which decodes to +/-inf.
+ */
+float decodeFloat32Auto(uint32_t bits);
+
+/**
+ * Decodes @p count consecutive big-endian float32_auto values starting at @p data into @p out.
+ *
+ * Byte swapping and classification are done with AVX2, SSSE3 or SSE2, whichever the compiler
+ * targets, or with NEON if built with VESC_DRIVER_NEON, with a scalar loop for the remainder.
+ * Lanes with a zero or reserved exponent are patched up with decodeFloat32Auto(), so the output is
+ * bit-for-bit that of calling decodeFloat32Auto() on each value.
+ */
+void decodeFloat32AutoBlock(const uint8_t * data, std::size_t count, float * out);
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_FLOAT_DECODE_HPP_
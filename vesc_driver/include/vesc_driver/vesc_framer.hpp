@@ -0,0 +1,120 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_FRAMER_HPP_
+#define VESC_DRIVER__VESC_FRAMER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <utility>
+
+#include "vesc_driver/vesc_error.hpp"
+#include "vesc_driver/vesc_packet.hpp"
+
+namespace vesc_driver
+{
+
+/**
+ * Splits a raw VESC byte stream into packets. Bytes are appended with push() as they arrive from
+ * the serial port, and every complete, valid frame is handed to the packet handler in stream
+ * order.
+ *
+ * Resynchronization runs in bounded time. A start-of-frame candidate whose length field asks for
+ * more bytes than are buffered is only waited on while no later candidate in the buffer forms a
+ * complete frame with a valid checksum. Later candidates are validated as their bytes arrive, so an
+ * unverified length field stalls the framer until the next good frame arrives at most, rather
+ * than until up to 1 KB of garbage has been received. The search resumes where the previous push()
+ * left off, so each byte is examined a bounded number of times however the stream is split.
+ */
+class VescFramer
+{
+public:
+  typedef std::function<void (const VescPacketConstPtr &)> PacketHandlerFunction;
+  /** Called with the reason and the number of bytes discarded (0 for a rejected candidate). */
+  typedef std::function<void (VescErrorCode, std::size_t)> ErrorHandlerFunction;
+
+  VescFramer(
+    const PacketHandlerFunction & packet_handler = PacketHandlerFunction(),
+    const ErrorHandlerFunction & error_handler = ErrorHandlerFunction());
+
+  void setPacketHandler(const PacketHandlerFunction & handler);
+  void setErrorHandler(const ErrorHandlerFunction & handler);
+
+  /**
+   * Appends @p size bytes to the stream and dispatches every packet that can be completed.
+   * Packets completed by these bytes get @p stamp_ns, the time they were read, as their
+   * VescFrame::rxStamp().
+   */
+  void push(const uint8_t * data, std::size_t size, int64_t stamp_ns = 0);
+
+  /**
+   * Discards all buffered bytes, e.g. after the serial port was reopened.
+   */
+  void reset();
+
+  /**
+   * @return Number of bytes held back waiting for the rest of a frame.
+   */
+  std::size_t buffered() const;
+
+private:
+  /**
+   * Searches [@p begin, @p end) for a start-of-frame character that starts a complete and valid
+   * frame. Candidates examined by earlier calls are only examined again if they were incomplete
+   * and enough bytes have arrived since.
+   *
+   * @param packet[out] The packet found, if any.
+   *
+   * @return Iterator to the start of the valid frame, or @p end if there is none.
+   */
+  Buffer::const_iterator findValidFrame(
+    Buffer::const_iterator begin, Buffer::const_iterator end,
+    VescPacketPtr * packet);
+
+  void reportError(VescErrorCode error, std::size_t num_bytes) const;
+
+  PacketHandlerFunction packet_handler_;
+  ErrorHandlerFunction error_handler_;
+  Buffer buffer_;
+  uint64_t sequence_;  ///< sequence number of the last packet dispatched
+
+  // findValidFrame() state as offsets into the stream; a candidate found invalid stays invalid
+  uint64_t stream_offset_;  ///< stream offset of the first byte in buffer_
+  uint64_t search_offset_;  ///< first byte not yet examined
+  /** Candidates found incomplete, with the stream size at which to examine them again. */
+  std::deque<std::pair<uint64_t, uint64_t>> incomplete_;
+  uint64_t recheck_size_;   ///< smallest stream size in incomplete_, or less
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_FRAMER_HPP_
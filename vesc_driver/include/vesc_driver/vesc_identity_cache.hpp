@@ -0,0 +1,145 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_IDENTITY_CACHE_HPP_
+#define VESC_DRIVER__VESC_IDENTITY_CACHE_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace vesc_driver
+{
+
+/**
+ * The identity cache is a fixed-size file holding a VescIdentityCacheHeader followed by
+ * VESC_IDENTITY_CACHE_CAPACITY VescIdentityCacheEntry slots. It is memory-mapped shared, so all
+ * processes using it (udev helpers, drivers) see each other's updates, and serialized with flock().
+ * All integers are stored in host byte order.
+ */
+struct VescIdentityCacheHeader
+{
+  char magic[8];      ///< VESC_IDENTITY_CACHE_MAGIC
+  uint32_t version;   ///< VESC_IDENTITY_CACHE_VERSION
+  uint32_t capacity;  ///< number of entry slots
+};
+
+struct VescIdentityCacheEntry
+{
+  char usb_serial[64];   ///< USB serial number of the port's device, empty if not USB
+  char path[128];        ///< serial port path
+  uint8_t uuid[12];      ///< VESC UUID as reported by COMM_FW_VERSION
+  char hwname[36];       ///< hardware name as reported by COMM_FW_VERSION
+  int32_t fw_major;
+  int32_t fw_minor;
+  int64_t updated;       ///< time the entry was stored, seconds since the epoch
+  uint32_t in_use;       ///< 1 if the slot holds an entry
+  uint32_t shared;       ///< 1 if usb_serial was also seen with another UUID, never found then
+};
+
+static const char VESC_IDENTITY_CACHE_MAGIC[8] = {'V', 'E', 'S', 'C', 'I', 'D', 'C', '\0'};
+static const uint32_t VESC_IDENTITY_CACHE_VERSION = 2;
+static const uint32_t VESC_IDENTITY_CACHE_CAPACITY = 64;
+
+/** What a VESC reports about itself in reply to COMM_FW_VERSION. */
+struct VescIdentity
+{
+  std::array<uint8_t, 12> uuid;
+  std::string hwname;
+  int fw_major;
+  int fw_minor;
+
+  /** @return The UUID formatted as vesc_device_namer prints it. */
+  std::string uuidString() const;
+};
+
+/**
+ * Persistent map from (USB serial number, port path) to the identity of the VESC found there, so
+ * that a port need not be opened to learn which VESC is behind it. Thread-safe.
+ *
+ * The USB serial number is not proof of identity: a USB stack may report the same one on every
+ * unit. Users re-validate each entry they use with a COMM_FW_VERSION reply and store() what the
+ * VESC reports. A serial number that turns out to come with more than one UUID, whether from a
+ * swapped controller or from two ports, is marked shared and not trusted any more.
+ */
+class VescIdentityCache
+{
+public:
+  /**
+   * Maps the cache file at @p path, creating it or resetting it if it is not a cache file of this
+   * version.
+   *
+   * @throw std::runtime_error if the file cannot be opened or mapped.
+   */
+  explicit VescIdentityCache(const std::string & path);
+  ~VescIdentityCache();
+
+  VescIdentityCache(const VescIdentityCache &) = delete;
+  VescIdentityCache & operator=(const VescIdentityCache &) = delete;
+
+  /**
+   * @return true and the cached identity in @p identity if there is an entry for the key. A device
+   *         without a USB serial number, or with one that is shared, is never found, since any
+   *         device could be at its path.
+   */
+  bool find(const std::string & usb_serial, const std::string & path, VescIdentity * identity);
+
+  /**
+   * Adds or replaces the entry for the key, evicting the oldest entry if the cache is full. Does
+   * nothing if @p usb_serial is empty. If another UUID is or was stored for @p usb_serial, every
+   * entry for it is marked shared.
+   */
+  void store(
+    const std::string & usb_serial, const std::string & path, const VescIdentity & identity);
+
+  /** Removes the entry for the key, if any. */
+  void invalidate(const std::string & usb_serial, const std::string & path);
+
+private:
+  VescIdentityCacheEntry * findEntry(const std::string & usb_serial, const std::string & path);
+
+  std::mutex mutex_;                    ///< flock() does not exclude threads sharing fd_
+  int fd_;
+  uint8_t * map_;
+  std::size_t size_;
+  VescIdentityCacheEntry * entries_;
+};
+
+/**
+ * @return USB serial number of the device behind the serial port @p port (symlinks such as
+ *         /dev/vesc/... are resolved), read from sysfs, or an empty string if it has none.
+ */
+std::string usbSerialNumber(const std::string & port);
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_IDENTITY_CACHE_HPP_
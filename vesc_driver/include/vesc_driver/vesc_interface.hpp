@@ -31,8 +31,13 @@
 #ifndef VESC_DRIVER__VESC_INTERFACE_HPP_
 #define VESC_DRIVER__VESC_INTERFACE_HPP_
 
+#include "vesc_driver/vesc_delay_estimator.hpp"
+#include "vesc_driver/vesc_error.hpp"
+#include "vesc_driver/vesc_link_stats.hpp"
 #include "vesc_driver/vesc_packet.hpp"
 
+#include <chrono>
+#include <cstddef>
 #include <exception>
 #include <functional>
 #include <memory>
@@ -50,7 +55,7 @@ class VescInterface
 {
 public:
   typedef std::function<void (const VescPacketConstPtr &)> PacketHandlerFunction;
-  typedef std::function<void (const std::string &)> ErrorHandlerFunction;
+  typedef std::function<void (VescErrorCode, std::size_t)> ErrorHandlerFunction;
 
   /**
    * Creates a VescInterface object. Opens the serial port interface to the VESC if @p port is not
@@ -59,7 +64,8 @@ public:
    * @param port Address of the serial port, e.g. '/dev/ttyUSB0'.
    * @param packet_handler Function this class calls when a VESC packet is received.
    * @param error_handler Function this class calls when an error is detected, such as a bad
-   *                      checksum.
+   *                      checksum, with the error code and the number of bytes discarded. Errors
+   *                      are also counted, see errorCounts().
    *
    * @throw SerialException
    */
@@ -91,32 +97,115 @@ public:
   void setErrorHandler(const ErrorHandlerFunction & handler);
 
   /**
-   * Opens the serial port interface to the VESC.
+   * Opens the serial port interface to the VESC. The port is locked with flock() while it is open,
+   * so no other VescInterface, in this process or another, can open it at the same time.
    *
-   * @throw SerialException
+   * @throw SerialException, also if the port is in use by another VescInterface.
    */
   void connect(const std::string & port);
 
   /**
-   * Closes the serial port interface to the VESC.
+   * Closes the serial port interface to the VESC. Also releases a port whose link has failed, so
+   * that connect() can be called again. Does not wait for the device, a port on which nothing
+   * answers closes just as quickly. Must not be called from a packet or error handler.
    */
   void disconnect();
 
   /**
    * Gets the status of the serial interface to the VESC.
    *
-   * @return Returns true if the serial port is open, false otherwise.
+   * @return Returns true if the serial port is open and no write on it has failed, false
+   *         otherwise, e.g. after the USB device went away.
    */
   bool isConnected() const;
 
   /**
-   * Send a VESC packet.
+   * Send a VESC packet. The frame is written immediately unless a TxBatch is in scope or a batch
+   * window is set, see setTxBatchWindow().
+   *
+   * @throw SerialException if writing to the serial port fails.
    */
   void send(const VescPacket & packet);
 
+  /**
+   * Collects the frames sent while it is in scope and writes them to the serial port in one
+   * contiguous write when the outermost TxBatch goes out of scope. Batches may nest. If that
+   * write fails the frames are dropped, since a destructor cannot throw.
+   */
+  class TxBatch
+  {
+public:
+    explicit TxBatch(VescInterface & vesc);
+    ~TxBatch();
+    TxBatch(const TxBatch &) = delete;
+    TxBatch & operator=(const TxBatch &) = delete;
+
+private:
+    VescInterface & vesc_;
+  };
+
+  /**
+   * Holds frames sent outside a TxBatch for up to @p window after the first one, so that frames
+   * sent in quick succession (e.g. from several command callbacks) share one serial write. A
+   * window of zero, the default, writes every frame immediately.
+   */
+  void setTxBatchWindow(std::chrono::microseconds window);
+
+  /**
+   * Starts writing every chunk read from and sent to the serial port, with CLOCK_MONOTONIC
+   * timestamps, to the capture file at @p path. Replaces any recording already in progress.
+   *
+   * @throw std::runtime_error if the capture file cannot be opened.
+   */
+  void startRecording(const std::string & path);
+
+  /**
+   * Stops recording and closes the capture file.
+   *
+   * @throw std::runtime_error if part of the capture could not be written.
+   */
+  void stopRecording();
+
+  /** @return true while recording; a failed write to the capture file ends the recording. */
+  bool isRecording() const;
+
+  /**
+   * @return Why the recording ended after a failed write, or an empty string. The error is
+   *         reported once.
+   */
+  std::string takeRecordingError();
+
+  /**
+   * @return Number of errors detected on the serial stream since construction, per error code.
+   */
+  VescErrorCounts errorCounts() const;
+
+  /**
+   * @return Round trip times of requests answered by the VESC and the time of the last packet
+   *         received.
+   */
+  VescLinkStats::Summary linkStats() const;
+
+  /**
+   * @return Estimated delay between the VESC sampling telemetry and the host reading it, see
+   *         VescDelayEstimator.
+   */
+  VescDelayEstimator::Estimate delayEstimate() const;
+
+  /**
+   * @return Estimated CLOCK_MONOTONIC time at which the VESC sampled the values in a received
+   *         @p frame, i.e. its VescFrame::rxStamp() less the estimated reply delay.
+   */
+  int64_t sampleStamp(const VescFrame & frame) const;
+
   void requestFWVersion();
   void requestState();
-  void requestImuData();
+  /** Request the motor configuration, answered by a VescPacketMcConf. */
+  void requestMcConf();
+  /** Request the app configuration, answered by a VescPacketAppConf. */
+  void requestAppConf();
+  /** Request IMU data; @p mask selects the fields, see VescImuMask. */
+  void requestImuData(uint16_t mask = IMU_MASK_ALL);
 
   void setDutyCycle(double duty_cycle);
   void setCurrent(double current);
@@ -124,6 +213,8 @@ public:
   void setSpeed(double speed);
   void setPosition(double position);
   void setServo(double servo);
+  /** Reset the VESC's command timeout, see VescPacketAlive. */
+  void sendAlive();
 
 private:
   // Pimpl - hide serial port members from class users
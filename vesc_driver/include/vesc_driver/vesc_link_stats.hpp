@@ -0,0 +1,101 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_LINK_STATS_HPP_
+#define VESC_DRIVER__VESC_LINK_STATS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "vesc_driver/vesc_packet.hpp"
+
+namespace vesc_driver
+{
+
+/**
+ * Tracks request/response round trip times on the serial link. Requests are matched to responses
+ * by payload id in send order, which is how the VESC answers them. Requests that stay unanswered
+ * for longer than the timeout are counted as lost and dropped, so a lost response does not skew
+ * later samples.
+ */
+class VescLinkStats
+{
+public:
+  struct Summary
+  {
+    std::size_t num_samples;   ///< number of RTT samples in the window
+    double rtt_p50;            ///< RTT percentiles over the window, in seconds
+    double rtt_p95;
+    double rtt_p99;
+    double rtt_max;
+    uint64_t num_lost;         ///< requests never answered, since construction
+    int64_t last_packet_ns;    ///< CLOCK_MONOTONIC time of the last packet received, or -1
+  };
+
+  /**
+   * @param window Number of most recent RTT samples kept for the percentiles.
+   * @param timeout_ns Time after which an unanswered request is considered lost.
+   */
+  explicit VescLinkStats(std::size_t window = 256, int64_t timeout_ns = 1000000000);
+
+  /**
+   * Records a frame with payload @p payload_id written to the VESC at @p stamp_ns. Call this
+   * before the write, so that the response cannot be received first.
+   */
+  void onSend(int payload_id, int64_t stamp_ns);
+
+  /**
+   * Records a packet received from the VESC whose last byte arrived at @p stamp_ns.
+   *
+   * @return The round trip time in nanoseconds if the packet answers an outstanding request, -1
+   *         otherwise.
+   */
+  int64_t onReceive(const VescFrame & frame, int64_t stamp_ns);
+
+  Summary summary() const;
+
+private:
+  mutable std::mutex mutex_;
+  int64_t timeout_ns_;
+  std::map<int, std::deque<int64_t>> outstanding_;  ///< send stamps of unanswered requests
+  std::vector<int64_t> rtt_;                        ///< ring buffer of RTT samples
+  std::size_t rtt_next_;
+  bool rtt_full_;
+  uint64_t num_lost_;
+  int64_t last_packet_ns_;
+};
+
+}  // namespace vesc_driver
+
+#endif  // VESC_DRIVER__VESC_LINK_STATS_HPP_
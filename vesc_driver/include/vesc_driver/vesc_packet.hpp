@@ -59,6 +59,27 @@ public:
     return *frame_;
   }
 
+  /** Payload id (COMM_PACKET_ID) of the frame, or -1 if it has no payload. */
+  int payloadId() const
+  {
+    return payload_.first != payload_.second ? *payload_.first : -1;
+  }
+
+  /** Position of a received frame in the stream, 0 for frames created locally. */
+  uint64_t sequence() const
+  {
+    return sequence_;
+  }
+
+  /**
+   * CLOCK_MONOTONIC time, in nanoseconds, of the serial read that completed a received frame, 0
+   * for frames created locally. See monotonicNanoseconds().
+   */
+  int64_t rxStamp() const
+  {
+    return rx_stamp_;
+  }
+
   // VESC packet properties
   static const int VESC_MAX_PAYLOAD_SIZE = 1024;           ///< Maximum VESC payload size, in bytes
   static const int VESC_MIN_FRAME_SIZE = 5;                ///< Smallest VESC frame size, in bytes
@@ -78,6 +99,8 @@ protected:
 
   std::shared_ptr<Buffer> frame_;  ///< Stores frame data, shared_ptr for shallow copy
   BufferRange payload_;              ///< View into frame's payload section
+  uint64_t sequence_;                ///< Set by VescFramer, used to correlate trace events
+  int64_t rx_stamp_;                 ///< Set by VescFramer, see rxStamp()
 
 private:
   /** Construct from buffer. Used by VescPacketFactory factory. */
@@ -85,6 +108,9 @@ private:
 
   /** Give VescPacketFactory access to private constructor. */
   friend class VescPacketFactory;
+
+  /** Give VescFramer access to the receive metadata. */
+  friend class VescFramer;
 };
 
 /*------------------------------------------------------------------------------------------------*/
@@ -141,6 +167,89 @@ public:
   VescPacketRequestFWVersion();
 };
 
+/** Resets the VESC's command timeout (app_configuration timeout_msec) without changing outputs. */
+class VescPacketAlive : public VescPacket
+{
+public:
+  VescPacketAlive();
+};
+
+/*------------------------------------------------------------------------------------------------*/
+
+/**
+ * A configuration in the firmware's own layout, which is only decoded by the VescConfCodec for the
+ * firmware version, see mcConfCodec() and appConfCodec().
+ */
+class VescPacketConf : public VescPacket
+{
+public:
+  /** @return Layout signature, 0 if the payload is too short to carry one. */
+  uint32_t signature() const;
+  /** @return The serialized fields following the signature. */
+  BufferRangeConst data() const;
+
+protected:
+  VescPacketConf(const std::string & name, std::shared_ptr<VescFrame> raw);
+  /** Builds a packet carrying @p signature and @p data, as a large frame if it needs one. */
+  VescPacketConf(
+    const std::string & name, int payload_id, uint32_t signature,
+    const std::vector<uint8_t> & data);
+};
+
+/** Reply to COMM_GET_MCCONF: the motor configuration. */
+class VescPacketMcConf : public VescPacketConf
+{
+public:
+  explicit VescPacketMcConf(std::shared_ptr<VescFrame> raw);
+};
+
+class VescPacketRequestMcConf : public VescPacket
+{
+public:
+  VescPacketRequestMcConf();
+};
+
+/** Replaces the motor configuration, acknowledged by a VescPacketSetMcConfAck. */
+class VescPacketSetMcConf : public VescPacketConf
+{
+public:
+  VescPacketSetMcConf(uint32_t signature, const std::vector<uint8_t> & data);
+};
+
+/** Sent by the firmware once a COMM_SET_MCCONF was applied and stored. */
+class VescPacketSetMcConfAck : public VescPacket
+{
+public:
+  explicit VescPacketSetMcConfAck(std::shared_ptr<VescFrame> raw);
+};
+
+/** Reply to COMM_GET_APPCONF: the app configuration. */
+class VescPacketAppConf : public VescPacketConf
+{
+public:
+  explicit VescPacketAppConf(std::shared_ptr<VescFrame> raw);
+};
+
+class VescPacketRequestAppConf : public VescPacket
+{
+public:
+  VescPacketRequestAppConf();
+};
+
+/** Replaces the app configuration, acknowledged by a VescPacketSetAppConfAck. */
+class VescPacketSetAppConf : public VescPacketConf
+{
+public:
+  VescPacketSetAppConf(uint32_t signature, const std::vector<uint8_t> & data);
+};
+
+/** Sent by the firmware once a COMM_SET_APPCONF was applied and stored. */
+class VescPacketSetAppConfAck : public VescPacket
+{
+public:
+  explicit VescPacketSetAppConfAck(std::shared_ptr<VescFrame> raw);
+};
+
 /*------------------------------------------------------------------------------------------------*/
 
 class VescPacketValues : public VescPacket
@@ -241,10 +350,23 @@ public:
 };
 
 /*------------------------------------------------------------------------------------------------*/
+/** Bits of the COMM_GET_IMU_DATA mask; the response carries one float for each bit set. */
+typedef enum
+{
+  IMU_MASK_RPY = 0x0007,
+  IMU_MASK_ACC = 0x0038,
+  IMU_MASK_GYR = 0x01C0,
+  IMU_MASK_MAG = 0x0E00,
+  IMU_MASK_QUAT = 0xF000,
+  IMU_MASK_ALL = 0xFFFF
+}
+VescImuMask;
+
 class VescPacketRequestImu : public VescPacket
 {
 public:
-  VescPacketRequestImu();
+  /** Requests the fields selected by @p mask, a combination of VescImuMask bits. */
+  explicit VescPacketRequestImu(uint16_t mask = IMU_MASK_ALL);
 };
 
 class VescPacketImu : public VescPacket
@@ -253,6 +375,8 @@ public:
   explicit VescPacketImu(std::shared_ptr<VescFrame> raw);
 
   int    mask()  const;
+  /** @return True if every field selected by @p mask is present. Absent fields read as zero. */
+  bool   has(uint16_t mask) const;
 
   double yaw()   const;
   double pitch() const;
@@ -276,8 +400,6 @@ public:
   double q_z() const;
 
 private:
-  double getFloat32Auto(uint32_t * pos) const;
-
   uint32_t mask_;
   double roll_;
   double pitch_;
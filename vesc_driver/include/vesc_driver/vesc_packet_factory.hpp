@@ -31,6 +31,7 @@
 #ifndef VESC_DRIVER__VESC_PACKET_FACTORY_HPP_
 #define VESC_DRIVER__VESC_PACKET_FACTORY_HPP_
 
+#include "vesc_driver/vesc_error.hpp"
 #include "vesc_driver/vesc_packet.hpp"
 
 #include <cstdint>
@@ -58,24 +59,24 @@ public:
    * at @p end is not examined, i.e. it can be the past-the-end element. Only returns a packet if
    * the packet is valid, i.e. valid size, matching checksum, complete etc. An empty pointer is
    * returned if a packet cannot be found or if it is invalid. If a valid packet is not found,
-   * optional output parameter @what is set to a string providing a reason why a packet was not
-   * found. If a packet was not found because additional bytes are needed on the buffer, optional
-   * output parameter @p num_bytes_needed will contain the number of bytes needed to either
-   * determine the size of the packet or complete the packet. Output parameters @p num_bytes_needed
-   * and @p what will be set to 0 and empty if a valid packet is found.
+   * optional output parameter @p error is set to the reason why a packet was not found. If a
+   * packet was not found because additional bytes are needed on the buffer, optional output
+   * parameter @p num_bytes_needed will contain the number of bytes needed to either determine the
+   * size of the packet or complete the packet. Output parameter @p num_bytes_needed will be set to
+   * 0 and @p error is left untouched if a valid packet is found.
    *
    * @param begin[in] Iterator to a buffer at the start-of-frame character
    * @param end[in] Iterator to the buffer past-the-end element.
    * @param num_bytes_needed[out] Number of bytes needed to determine the packet size or complete
    *                              the frame.
-   * @param what[out] Human readable string giving a reason why the packet was not found.
+   * @param error[out] Reason why the packet was not found, see vescErrorString().
    *
    * @return Pointer to a valid VescPacket if successful. Otherwise, an empty pointer.
    */
   static VescPacketPtr createPacket(
     const Buffer::const_iterator & begin,
     const Buffer::const_iterator & end,
-    int * num_bytes_needed, std::string * what);
+    int * num_bytes_needed, VescErrorCode * error);
 
   typedef std::function<VescPacketPtr(std::shared_ptr<VescFrame>)> CreateFn;
 
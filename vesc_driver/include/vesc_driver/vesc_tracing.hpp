@@ -0,0 +1,52 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#ifndef VESC_DRIVER__VESC_TRACING_HPP_
+#define VESC_DRIVER__VESC_TRACING_HPP_
+
+/**
+ * Static tracepoints on the receive (serial read -> framing -> packet callback -> publish) and
+ * transmit (command callback -> send -> serial write) paths. They are only compiled in when the
+ * package is built with -DVESC_DRIVER_TRACING=ON, otherwise VESC_TRACEPOINT() expands to nothing
+ * and its arguments are not evaluated.
+ *
+ * Events carry correlation ids: a per-chunk sequence for serial reads, VescFrame::sequence() for
+ * received packets and a per-frame sequence for transmitted frames. See
+ * scripts/vesc_trace_analysis.py for reconstructing per-packet timelines.
+ */
+
+#ifdef VESC_DRIVER_TRACING_ENABLED
+#include "vesc_driver/vesc_driver_tp.h"
+#define VESC_TRACEPOINT(event, ...) tracepoint(vesc_driver, event, __VA_ARGS__)
+#else
+#define VESC_TRACEPOINT(event, ...) ((void)0)
+#endif
+
+#endif  // VESC_DRIVER__VESC_TRACING_HPP_
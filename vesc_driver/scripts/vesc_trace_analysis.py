@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+# Copyright 2020 F1TENTH Foundation
+#
+# Redistribution and use in source and binary forms, with or without modification, are permitted
+# provided that the following conditions are met:
+#
+#   * Redistributions of source code must retain the above copyright notice, this list of
+#     conditions and the following disclaimer.
+#
+#   * Redistributions in binary form must reproduce the above copyright notice, this list of
+#     conditions and the following disclaimer in the documentation and/or other materials provided
+#     with the distribution.
+#
+#   * Neither the name of the {copyright_holder} nor the names of its contributors may be used to
+#     endorse or promote products derived from this software without specific prior written
+#     permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+# ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+"""
+Reconstruct per-packet timelines from an LTTng trace of vesc_driver and print latency
+distributions for each pipeline stage.
+
+Record a trace with:
+
+    lttng create vesc && lttng enable-event -u 'vesc_driver:*' && lttng start
+    ... run the driver built with -DVESC_DRIVER_TRACING=ON ...
+    lttng stop && lttng destroy
+
+then run this script on the trace directory. Requires the babeltrace2 python bindings (bt2).
+"""
+
+import argparse
+import collections
+import sys
+
+try:
+    import bt2
+except ImportError:
+    sys.exit('vesc_trace_analysis.py requires the babeltrace2 python bindings (python3-bt2)')
+
+
+RX_STAGES = [
+    ('created -> callback', 'packet_created', 'packet_callback_begin'),
+    ('callback -> publish', 'packet_callback_begin', 'packet_published'),
+    ('callback duration', 'packet_callback_begin', 'packet_callback_end'),
+    ('created -> publish', 'packet_created', 'packet_published'),
+]
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return float('nan')
+    index = min(len(sorted_values) - 1, int(p / 100.0 * len(sorted_values)))
+    return sorted_values[index]
+
+
+def print_distribution(name, values_ns):
+    values = sorted(v / 1e3 for v in values_ns)
+    if not values:
+        print('%-24s %8d' % (name, 0))
+        return
+    print('%-24s %8d %10.1f %10.1f %10.1f %10.1f %10.1f' % (
+        name, len(values), values[0], percentile(values, 50), percentile(values, 95),
+        percentile(values, 99), values[-1]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument('trace', help='LTTng trace directory')
+    args = parser.parse_args()
+
+    # first timestamp of each event, keyed by frame sequence
+    rx = collections.defaultdict(dict)
+    # (stamp, topic) of the most recent command callback, matched to the next transmitted frame
+    pending_command = None
+    tx = {}
+    command_to_write = collections.defaultdict(list)
+    rx_chunk_sizes = []
+
+    for msg in bt2.TraceCollectionMessageIterator(args.trace):
+        if type(msg) is not bt2._EventMessageConst:
+            continue
+        event = msg.event
+        if not event.name.startswith('vesc_driver:'):
+            continue
+        name = event.name.split(':', 1)[1]
+        stamp = msg.default_clock_snapshot.ns_from_origin
+        fields = event.payload_field
+
+        if name == 'rx_chunk':
+            rx_chunk_sizes.append(int(fields['size']))
+        elif name in ('packet_created', 'packet_callback_begin', 'packet_callback_end',
+                      'packet_published'):
+            rx[int(fields['frame_seq'])].setdefault(name, stamp)
+        elif name == 'command_received':
+            pending_command = (stamp, str(fields['topic']))
+        elif name == 'tx_enqueue':
+            tx[int(fields['tx_seq'])] = stamp
+        elif name == 'tx_write':
+            first, last = int(fields['first_seq']), int(fields['last_seq'])
+            if pending_command is not None and first in tx:
+                command_to_write[pending_command[1]].append(stamp - pending_command[0])
+                pending_command = None
+            for seq in range(first, last + 1):
+                tx.pop(seq, None)
+
+    print('%-24s %8s %10s %10s %10s %10s %10s' % (
+        'stage [us]', 'count', 'min', 'p50', 'p95', 'p99', 'max'))
+    for stage, begin, end in RX_STAGES:
+        print_distribution(stage, [
+            events[end] - events[begin] for events in rx.values()
+            if begin in events and end in events])
+    for topic in sorted(command_to_write):
+        print_distribution(topic + ' -> write', command_to_write[topic])
+
+    if rx_chunk_sizes:
+        rx_chunk_sizes.sort()
+        print('\nserial reads: %d, bytes p50 %d max %d' % (
+            len(rx_chunk_sizes), percentile(rx_chunk_sizes, 50), rx_chunk_sizes[-1]))
+
+
+if __name__ == '__main__':
+    main()
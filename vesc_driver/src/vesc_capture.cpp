@@ -0,0 +1,219 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_capture.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace vesc_driver
+{
+
+int64_t monotonicNanoseconds()
+{
+  // steady_clock is CLOCK_MONOTONIC on Linux
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+VescCaptureWriter::VescCaptureWriter(const std::string & path)
+: file_(fopen(path.c_str(), "wb"))
+{
+  if (file_ == NULL) {
+    throw std::runtime_error("Failed to open capture file " + path + ": " + strerror(errno));
+  }
+  // serial chunks are small, so let stdio batch them into large writes
+  setvbuf(file_, NULL, _IOFBF, 1 << 16);
+
+  VescCaptureFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, VESC_CAPTURE_MAGIC, sizeof(header.magic));
+  header.version = VESC_CAPTURE_VERSION;
+  // the header is still buffered, so flush to find out whether the file is writable at all
+  if (fwrite(&header, sizeof(header), 1, file_) != 1 || fflush(file_) != 0) {
+    std::string reason = strerror(errno);
+    fclose(file_);
+    throw std::runtime_error("Failed to write capture file " + path + ": " + reason);
+  }
+}
+
+VescCaptureWriter::~VescCaptureWriter()
+{
+  close();
+}
+
+bool VescCaptureWriter::write(
+  VescCaptureDirection direction, const uint8_t * data, std::size_t size)
+{
+  return write(monotonicNanoseconds(), direction, data, size);
+}
+
+bool VescCaptureWriter::write(
+  int64_t stamp_ns, VescCaptureDirection direction, const uint8_t * data, std::size_t size)
+{
+
+  VescCaptureRecordHeader header;
+  memset(&header, 0, sizeof(header));
+  header.stamp_ns = stamp_ns;
+  header.size = static_cast<uint32_t>(size);
+  header.direction = static_cast<uint8_t>(direction);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_ == NULL || !error_.empty()) {
+    return false;
+  }
+  if (size == 0) {
+    return true;
+  }
+  if (fwrite(&header, sizeof(header), 1, file_) != 1 || fwrite(data, 1, size, file_) != size) {
+    fail("write");
+    return false;
+  }
+  return true;
+}
+
+bool VescCaptureWriter::flush()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_ == NULL || !error_.empty()) {
+    return false;
+  }
+  if (fflush(file_) != 0) {
+    fail("flush");
+    return false;
+  }
+  return true;
+}
+
+bool VescCaptureWriter::close()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_ == NULL) {
+    return error_.empty();
+  }
+  // fclose() still writes out the buffer, so it reports late write errors too
+  if (fclose(file_) != 0 && error_.empty()) {
+    fail("close");
+  }
+  file_ = NULL;
+  return error_.empty();
+}
+
+std::string VescCaptureWriter::error() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return error_;
+}
+
+void VescCaptureWriter::fail(const char * what)
+{
+  if (error_.empty()) {
+    error_ = std::string("capture file ") + what + " failed: " + strerror(errno);
+  }
+}
+
+VescCaptureReader::VescCaptureReader(const std::string & path)
+: map_(NULL), size_(0), offset_(sizeof(VescCaptureFileHeader))
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open capture file " + path + ": " + strerror(errno));
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(VescCaptureFileHeader))) {
+    ::close(fd);
+    throw std::runtime_error("Capture file " + path + " is too short.");
+  }
+  size_ = static_cast<std::size_t>(st.st_size);
+
+  void * map = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("Failed to map capture file " + path + ": " + strerror(errno));
+  }
+  map_ = static_cast<const uint8_t *>(map);
+  madvise(map, size_, MADV_SEQUENTIAL);
+
+  VescCaptureFileHeader header;
+  memcpy(&header, map_, sizeof(header));
+  if (memcmp(header.magic, VESC_CAPTURE_MAGIC, sizeof(header.magic)) != 0 ||
+    header.version != VESC_CAPTURE_VERSION)
+  {
+    munmap(map, size_);
+    throw std::runtime_error(path + " is not a VESC capture file.");
+  }
+}
+
+VescCaptureReader::~VescCaptureReader()
+{
+  munmap(const_cast<uint8_t *>(map_), size_);
+}
+
+bool VescCaptureReader::next(Record * record)
+{
+  if (size_ - offset_ < sizeof(VescCaptureRecordHeader)) {
+    return false;
+  }
+
+  VescCaptureRecordHeader header;
+  memcpy(&header, map_ + offset_, sizeof(header));
+  if (size_ - offset_ - sizeof(header) < header.size) {
+    // truncated, e.g. the recorder was killed mid-write
+    return false;
+  }
+
+  record->stamp_ns = header.stamp_ns;
+  record->direction = static_cast<VescCaptureDirection>(header.direction);
+  record->data = map_ + offset_ + sizeof(header);
+  record->size = header.size;
+  offset_ += sizeof(header) + header.size;
+  return true;
+}
+
+void VescCaptureReader::rewind()
+{
+  offset_ = sizeof(VescCaptureFileHeader);
+}
+
+std::size_t VescCaptureReader::size() const
+{
+  return size_;
+}
+
+}  // namespace vesc_driver
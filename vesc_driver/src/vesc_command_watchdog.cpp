@@ -0,0 +1,76 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_command_watchdog.hpp"
+
+namespace vesc_driver
+{
+
+VescCommandWatchdog::VescCommandWatchdog()
+: timeout_(0.0), last_command_ns_(0)
+{
+}
+
+void VescCommandWatchdog::setTimeout(double timeout)
+{
+  timeout_ = timeout;
+}
+
+void VescCommandWatchdog::commandReceived(int64_t stamp_ns)
+{
+  last_command_ns_ = stamp_ns;
+}
+
+void VescCommandWatchdog::reset()
+{
+  last_command_ns_ = 0;
+}
+
+double VescCommandWatchdog::age(int64_t now_ns) const
+{
+  const int64_t last_command_ns = last_command_ns_;
+  if (last_command_ns == 0) {
+    return -1.0;
+  }
+  return (now_ns - last_command_ns) * 1e-9;
+}
+
+bool VescCommandWatchdog::expired(int64_t now_ns) const
+{
+  return enabled() && age(now_ns) > timeout_;
+}
+
+bool VescCommandWatchdog::keepaliveDue(int64_t now_ns) const
+{
+  const double command_age = age(now_ns);
+  return enabled() && command_age >= 0.0 && command_age <= timeout_;
+}
+
+}  // namespace vesc_driver
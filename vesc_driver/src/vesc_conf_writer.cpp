@@ -0,0 +1,213 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_conf_writer.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vesc_driver
+{
+
+namespace
+{
+
+/** The packets that write, acknowledge and read back each kind of configuration. */
+template<typename Conf>
+struct VescConfPackets;
+
+template<>
+struct VescConfPackets<mc_configuration>
+{
+  typedef VescPacketSetMcConf Set;
+  typedef VescPacketSetMcConfAck Ack;
+  typedef VescPacketRequestMcConf Request;
+  typedef VescPacketMcConf Reply;
+};
+
+template<>
+struct VescConfPackets<app_configuration>
+{
+  typedef VescPacketSetAppConf Set;
+  typedef VescPacketSetAppConfAck Ack;
+  typedef VescPacketRequestAppConf Request;
+  typedef VescPacketAppConf Reply;
+};
+
+}  // namespace
+
+const char * confWriteResultString(conf_write_result_t result)
+{
+  switch (result) {
+    case CONF_WRITE_UNCHANGED:
+      return "unchanged";
+    case CONF_WRITE_VERIFIED:
+      return "verified";
+    case CONF_WRITE_MISMATCH:
+      return "mismatch";
+    case CONF_WRITE_TIMEOUT:
+      return "timeout";
+    case CONF_WRITE_REFUSED:
+      return "refused";
+  }
+  return "unknown";
+}
+
+template<typename Conf>
+VescConfWriter<Conf>::VescConfWriter(const VescConfCodec<Conf> & codec, SendFunction send)
+: codec_(codec), send_(send), stage_(STAGE_IDLE), read_signature_(0)
+{
+}
+
+template<typename Conf>
+bool VescConfWriter<Conf>::handlePacket(const VescPacket & packet)
+{
+  typedef VescConfPackets<Conf> Packets;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (stage_ == STAGE_ACK && dynamic_cast<const typename Packets::Ack *>(&packet) != NULL) {
+    stage_ = STAGE_ACKED;
+  } else if (stage_ == STAGE_READBACK) {
+    const auto * reply = dynamic_cast<const typename Packets::Reply *>(&packet);
+    if (reply == NULL) {
+      return false;
+    }
+    read_signature_ = reply->signature();
+    read_data_.assign(reply->data().first, reply->data().second);
+    stage_ = STAGE_READ;
+  } else {
+    return false;
+  }
+  condition_.notify_all();
+  return true;
+}
+
+template<typename Conf>
+bool VescConfWriter<Conf>::exchange(
+  stage_t stage, const VescPacket & packet, stage_t done, std::chrono::milliseconds timeout)
+{
+  // set the stage before sending, the reply may be handled before send_() returns
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stage_ = stage;
+  }
+  send_(packet);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  const bool received = condition_.wait_for(lock, timeout, [this, done] {return stage_ == done;});
+  stage_ = STAGE_IDLE;
+  return received;
+}
+
+template<typename Conf>
+conf_write_result_t VescConfWriter<Conf>::write(
+  const VescConfBlob & current, const Conf & desired, std::chrono::milliseconds timeout,
+  std::vector<std::string> * changed, VescConfBlob * readback)
+{
+  typedef VescConfPackets<Conf> Packets;
+
+  Conf current_conf = Conf();
+  if (current.fw_major != codec_.fwMajor() || current.fw_minor != codec_.fwMinor() ||
+    !codec_.decode(current.signature, current.data.data(), current.data.size(), &current_conf))
+  {
+    throw std::invalid_argument(
+            "Configuration does not match firmware " + std::to_string(codec_.fwMajor()) + "." +
+            std::to_string(codec_.fwMinor()));
+  }
+
+  if (changed != NULL) {
+    changed->clear();
+  }
+  const std::vector<std::string> edits = codec_.diff(current_conf, desired);
+  if (edits.empty()) {
+    return CONF_WRITE_UNCHANGED;
+  }
+
+  // the VESC may have been configured since current was read, e.g. with VESC Tool, so the changes
+  // are applied to what it holds now rather than written over it
+  if (!exchange(STAGE_READBACK, typename Packets::Request(), STAGE_READ, timeout)) {
+    return CONF_WRITE_TIMEOUT;
+  }
+  VescConfBlob device;
+  device.fw_major = current.fw_major;
+  device.fw_minor = current.fw_minor;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    device.signature = read_signature_;
+    device.data = read_data_;
+  }
+  Conf device_conf = Conf();
+  if (!codec_.decode(device.signature, device.data.data(), device.data.size(), &device_conf)) {
+    return CONF_WRITE_REFUSED;
+  }
+  if (readback != NULL) {
+    *readback = device;
+  }
+
+  Conf target = device_conf;
+  for (const auto & name : edits) {
+    const VescConfField & field = *codec_.field(name);
+    codec_.set(&target, field, codec_.get(desired, field));
+  }
+  const std::vector<std::string> fields = codec_.diff(device_conf, target);
+  if (changed != NULL) {
+    *changed = fields;
+  }
+  if (fields.empty()) {
+    return CONF_WRITE_UNCHANGED;
+  }
+
+  std::vector<uint8_t> data(codec_.size());
+  codec_.encode(target, data.data());
+
+  // more than 255 payload bytes, so VescFrame builds a large frame
+  if (!exchange(STAGE_ACK, typename Packets::Set(codec_.signature(), data), STAGE_ACKED, timeout)) {
+    return CONF_WRITE_TIMEOUT;
+  }
+  if (!exchange(STAGE_READBACK, typename Packets::Request(), STAGE_READ, timeout)) {
+    return CONF_WRITE_TIMEOUT;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (readback != NULL) {
+    readback->signature = read_signature_;
+    readback->data = read_data_;
+  }
+  return read_signature_ == codec_.signature() && read_data_ == data ?
+         CONF_WRITE_VERIFIED : CONF_WRITE_MISMATCH;
+}
+
+template class VescConfWriter<mc_configuration>;
+template class VescConfWriter<app_configuration>;
+
+}  // namespace vesc_driver
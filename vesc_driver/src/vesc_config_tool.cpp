@@ -0,0 +1,317 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/vesc_conf_writer.hpp"
+#include "vesc_driver/vesc_configuration.hpp"
+#include "vesc_driver/vesc_identity_cache.hpp"
+#include "vesc_driver/vesc_interface.hpp"
+#include "vesc_driver/vesc_packet.hpp"
+
+namespace
+{
+
+using vesc_driver::VescConfBlob;
+using vesc_driver::VescConfCodec;
+using vesc_driver::VescPacket;
+using vesc_driver::VescPacketConstPtr;
+
+void usage(const char * name)
+{
+  std::cerr << "Usage: " << name <<
+    " [-c <cache dir>] [-r] [-n] [-s <file>] [-t <ms>] <port> mcconf|appconf " <<
+    "[<field>=<value> ...]" << std::endl <<
+    "Prints the motor or app configuration of a VESC or, given assignments, writes the changed " <<
+    "fields and verifies them by reading the configuration back." << std::endl <<
+    "  -c  compare against and update the configurations cached in <cache dir>" << std::endl <<
+    "  -r  read the configuration from the VESC even if it is cached" << std::endl <<
+    "  -n  only print the fields that would be written" << std::endl <<
+    "  -s  save the configuration as sent by the VESC to <file> and exit, also for firmware " <<
+    "that is not supported, e.g. to add a capture to test/data" << std::endl <<
+    "  -t  timeout for each reply in ms, default 1000" << std::endl;
+}
+
+/** Replies from the VESC, collected on the read thread. */
+struct Session
+{
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool have_version = false;
+  int fw_major = 0;
+  int fw_minor = 0;
+  vesc_driver::VescIdentity identity;
+  bool have_conf = false;
+  VescConfBlob conf;
+  int conf_id = -1;   ///< payload id of the configuration to collect
+  std::function<bool(const VescPacket &)> forward;
+
+  void handle(const VescPacketConstPtr & packet)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (forward && forward(*packet)) {
+      return;
+    }
+    auto version = std::dynamic_pointer_cast<const vesc_driver::VescPacketFWVersion>(packet);
+    if (version && !have_version) {
+      fw_major = version->fwMajor();
+      fw_minor = version->fwMinor();
+      std::copy(version->uuid(), version->uuid() + identity.uuid.size(), identity.uuid.begin());
+      have_version = true;
+    }
+    auto conf_packet = std::dynamic_pointer_cast<const vesc_driver::VescPacketConf>(packet);
+    if (conf_packet && conf_packet->payloadId() == conf_id && !have_conf) {
+      conf.fw_major = fw_major;
+      conf.fw_minor = fw_minor;
+      conf.signature = conf_packet->signature();
+      conf.data.assign(conf_packet->data().first, conf_packet->data().second);
+      have_conf = true;
+    }
+    condition.notify_all();
+  }
+
+  bool wait(bool Session::* flag, std::chrono::milliseconds timeout)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    return condition.wait_for(lock, timeout, [this, flag] {return this->*flag;});
+  }
+};
+
+template<typename Conf>
+int run(
+  vesc_driver::VescInterface & vesc, Session & session, const VescConfCodec<Conf> & codec,
+  const std::string & kind, const std::vector<std::string> & assignments,
+  vesc_driver::VescConfCache * cache, bool refresh, bool dry_run,
+  std::chrono::milliseconds timeout)
+{
+  const std::string uuid = session.identity.uuidString();
+  VescConfBlob current;
+  if (cache == NULL || refresh || !cache->load(uuid, kind, &current) ||
+    current.fw_major != codec.fwMajor() || current.fw_minor != codec.fwMinor() ||
+    current.signature != codec.signature() || current.data.size() != codec.size())
+  {
+    if (kind == "mcconf") {
+      vesc.requestMcConf();
+    } else {
+      vesc.requestAppConf();
+    }
+    if (!session.wait(&Session::have_conf, timeout)) {
+      std::cerr << "No " << kind << " received from the VESC" << std::endl;
+      return -1;
+    }
+    std::lock_guard<std::mutex> lock(session.mutex);
+    current = session.conf;
+  }
+
+  Conf conf = Conf();
+  if (!codec.decode(current.signature, current.data.data(), current.data.size(), &conf)) {
+    std::cerr << "Unexpected " << kind << " layout, signature " << current.signature << " size " <<
+      current.data.size() << ", expected signature " << codec.signature() << " size " <<
+      codec.size() << std::endl;
+    return -1;
+  }
+
+  if (assignments.empty()) {
+    for (const auto & field : codec.fields()) {
+      printf("%s=%g\n", field.name, codec.get(conf, field));
+    }
+    return 0;
+  }
+
+  Conf desired = conf;
+  for (const auto & assignment : assignments) {
+    const std::size_t equals = assignment.find('=');
+    const vesc_driver::VescConfField * field =
+      equals == std::string::npos ? NULL : codec.field(assignment.substr(0, equals));
+    char * end = NULL;
+    const double value =
+      field == NULL ? 0.0 : strtod(assignment.c_str() + equals + 1, &end);
+    if (field == NULL || end == assignment.c_str() + equals + 1 || *end != '\0') {
+      std::cerr << "Invalid assignment " << assignment << std::endl;
+      return -1;
+    }
+    codec.set(&desired, *field, value);
+  }
+
+  if (dry_run) {
+    for (const auto & name : codec.diff(conf, desired)) {
+      printf("%s=%g\n", name.c_str(), codec.get(desired, *codec.field(name)));
+    }
+    return 0;
+  }
+
+  vesc_driver::VescConfWriter<Conf> writer(
+    codec, [&vesc](const VescPacket & packet) {vesc.send(packet);});
+  {
+    std::lock_guard<std::mutex> lock(session.mutex);
+    session.forward = [&writer](const VescPacket & packet) {return writer.handlePacket(packet);};
+  }
+
+  std::vector<std::string> changed;
+  VescConfBlob readback;
+  const vesc_driver::conf_write_result_t result =
+    writer.write(current, desired, timeout, &changed, &readback);
+  {
+    std::lock_guard<std::mutex> lock(session.mutex);
+    session.forward = nullptr;
+  }
+
+  for (const auto & name : changed) {
+    printf("%s=%g\n", name.c_str(), codec.get(desired, *codec.field(name)));
+  }
+  fprintf(stderr, "%s: %s\n", kind.c_str(), vesc_driver::confWriteResultString(result));
+
+  // cache what the VESC holds now, which after a mismatch is not what was asked for; the writer
+  // leaves readback empty if it read nothing usable
+  if (cache != NULL && !readback.data.empty()) {
+    try {
+      cache->store(uuid, kind, readback);
+    } catch (const std::runtime_error & e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+  return result == vesc_driver::CONF_WRITE_UNCHANGED ||
+         result == vesc_driver::CONF_WRITE_VERIFIED ? 0 : -1;
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  std::string cache_dir;
+  bool refresh = false;
+  bool dry_run = false;
+  std::string save_path;
+  std::chrono::milliseconds timeout(1000);
+  int opt;
+  while ((opt = getopt(argc, argv, "c:rns:t:h")) != -1) {
+    switch (opt) {
+      case 'c': cache_dir = optarg; break;
+      case 'r': refresh = true; break;
+      case 'n': dry_run = true; break;
+      case 's': save_path = optarg; break;
+      case 't': timeout = std::chrono::milliseconds(atoi(optarg)); break;
+      default: usage(argv[0]); return opt == 'h' ? 0 : -1;
+    }
+  }
+  if (argc - optind < 2) {
+    usage(argv[0]);
+    return -1;
+  }
+  const std::string port = argv[optind];
+  const std::string kind = argv[optind + 1];
+  if (kind != "mcconf" && kind != "appconf") {
+    usage(argv[0]);
+    return -1;
+  }
+  const std::vector<std::string> assignments(argv + optind + 2, argv + argc);
+
+  Session session;
+  session.conf_id = kind == "mcconf" ? vesc_driver::COMM_GET_MCCONF : vesc_driver::COMM_GET_APPCONF;
+  vesc_driver::VescInterface vesc(
+    std::string(),
+    [&session](const VescPacketConstPtr & packet) {session.handle(packet);});
+
+  try {
+    vesc.connect(port);
+    vesc.requestFWVersion();
+  } catch (const vesc_driver::SerialException & e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+  if (!session.wait(&Session::have_version, timeout)) {
+    std::cerr << "No firmware version received from the VESC on " << port << std::endl;
+    return -1;
+  }
+
+  // a capture is stored undecoded, it is what a codec for a new release is checked against
+  if (!save_path.empty()) {
+    if (kind == "mcconf") {
+      vesc.requestMcConf();
+    } else {
+      vesc.requestAppConf();
+    }
+    if (!session.wait(&Session::have_conf, timeout)) {
+      std::cerr << "No " << kind << " received from the VESC" << std::endl;
+      return -1;
+    }
+    try {
+      std::lock_guard<std::mutex> lock(session.mutex);
+      vesc_driver::storeConfBlob(save_path, session.conf);
+    } catch (const std::runtime_error & e) {
+      std::cerr << e.what() << std::endl;
+      return -1;
+    }
+    vesc.disconnect();
+    return 0;
+  }
+
+  std::unique_ptr<vesc_driver::VescConfCache> cache;
+  if (!cache_dir.empty()) {
+    cache.reset(new vesc_driver::VescConfCache(cache_dir));
+  }
+
+  const auto * mc_codec = vesc_driver::mcConfCodec(session.fw_major, session.fw_minor);
+  const auto * app_codec = vesc_driver::appConfCodec(session.fw_major, session.fw_minor);
+  if (kind == "mcconf" ? mc_codec == NULL : app_codec == NULL) {
+    std::cerr << "Firmware " << session.fw_major << "." << session.fw_minor <<
+      " is not supported" << std::endl;
+    return -1;
+  }
+
+  int result;
+  try {
+    if (kind == "mcconf") {
+      result = run(
+        vesc, session, *mc_codec, kind, assignments, cache.get(), refresh, dry_run, timeout);
+    } else {
+      result = run(
+        vesc, session, *app_codec, kind, assignments, cache.get(), refresh, dry_run, timeout);
+    }
+  } catch (const vesc_driver::SerialException & e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  vesc.disconnect();
+  return result;
+}
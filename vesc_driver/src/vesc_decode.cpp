@@ -0,0 +1,450 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vesc_driver/vesc_capture.hpp"
+#include "vesc_driver/vesc_framer.hpp"
+#include "vesc_driver/vesc_packet.hpp"
+#include "vesc_driver/vesc_packet_factory.hpp"
+
+namespace
+{
+
+using vesc_driver::Buffer;
+using vesc_driver::VescFrame;
+using vesc_driver::VescFramer;
+using vesc_driver::VescPacketConstPtr;
+using vesc_driver::VescPacketFactory;
+using vesc_driver::VescPacketImu;
+using vesc_driver::VescPacketValues;
+
+/** A contiguous RX byte stream, with the stamp of the chunk each byte arrived in. */
+struct Stream
+{
+  const uint8_t * data;
+  std::size_t size;
+  std::vector<std::size_t> chunk_end;  ///< offset one past the last byte of each chunk
+  std::vector<int64_t> chunk_stamp;    ///< CLOCK_MONOTONIC ns, or -1 if unknown
+};
+
+/** Fields of a Values packet needed for the aggregates. */
+struct ValuesSample
+{
+  int64_t stamp_ns;
+  double v_in;
+  double current_motor;
+  double current_input;
+  double watt_hours;
+  double watt_hours_charged;
+  int32_t tachometer_abs;
+};
+
+/** Output of one decoding worker, formatted in parallel and written in stream order. */
+struct Segment
+{
+  std::size_t begin;
+  std::size_t end;
+  std::string values_csv;
+  std::string imu_csv;
+  std::vector<ValuesSample> values;
+  uint64_t num_packets = 0;
+  uint64_t num_errors = 0;
+};
+
+const char * VALUES_HEADER =
+  "stamp_ns,v_in,temp_fet,temp_motor,current_motor,current_input,avg_id,avg_iq,duty_cycle,rpm,"
+  "amp_hours,amp_hours_charged,watt_hours,watt_hours_charged,tachometer,tachometer_abs,"
+  "fault_code,pid_pos_now,controller_id,temp_mos1,temp_mos2,temp_mos3,avg_vd,avg_vq\n";
+
+const char * IMU_HEADER =
+  "stamp_ns,mask,roll,pitch,yaw,acc_x,acc_y,acc_z,gyr_x,gyr_y,gyr_z,mag_x,mag_y,mag_z,"
+  "q_w,q_x,q_y,q_z\n";
+
+void usage(const char * name)
+{
+  std::cerr << "Usage: " << name << " [-b] [-j threads] [-w seconds] [-n samples] [-o prefix] " <<
+    "<capture file>" << std::endl <<
+    "Decodes all VESC frames in a serial capture and writes <prefix>_values.csv, " <<
+    "<prefix>_imu.csv and windowed aggregates in <prefix>_summary.csv." << std::endl <<
+    "  -b  input is a raw byte stream rather than a vesc_replay capture" << std::endl <<
+    "  -j  number of decoding threads (default: all cores)" << std::endl <<
+    "  -w  aggregate window length in seconds (default: 1.0)" << std::endl <<
+    "  -n  aggregate window length in samples, for raw streams without stamps (default: 50)" <<
+    std::endl <<
+    "  -o  output file prefix (default: vesc)" << std::endl;
+}
+
+void appendf(std::string * out, const char * fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void appendf(std::string * out, const char * fmt, ...)
+{
+  char line[1024];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  out->append(line, std::min<std::size_t>(n, sizeof(line) - 1));
+}
+
+/**
+ * @return Offset of the first complete, valid frame at or after @p offset, or the stream size if
+ *         there is none.
+ */
+std::size_t findFrameBoundary(const Stream & stream, std::size_t offset)
+{
+  const std::size_t window = 4 * VescFrame::VESC_MAX_FRAME_SIZE;
+  Buffer buffer;
+  while (offset < stream.size) {
+    const std::size_t len = std::min(window, stream.size - offset);
+    buffer.assign(stream.data + offset, stream.data + offset + len);
+    // candidates in the last max-frame-size bytes are retried with the next window
+    const std::size_t last = len == stream.size - offset ?
+      len : len - VescFrame::VESC_MAX_FRAME_SIZE;
+    for (std::size_t i = 0; i < last; i++) {
+      if (VescFrame::VESC_SOF_VAL_SMALL_FRAME == buffer[i] ||
+        VescFrame::VESC_SOF_VAL_LARGE_FRAME == buffer[i])
+      {
+        int bytes_needed;
+        if (VescPacketFactory::createPacket(
+            buffer.begin() + i, buffer.end(), &bytes_needed, NULL))
+        {
+          return offset + i;
+        }
+      }
+    }
+    offset += last;
+  }
+  return stream.size;
+}
+
+void decodeSegment(const Stream & stream, Segment * segment)
+{
+  int64_t stamp_ns = -1;
+  VescFramer framer(
+    [&](const VescPacketConstPtr & packet) {
+      segment->num_packets++;
+      if (packet->name() == "Values") {
+        auto values = std::static_pointer_cast<VescPacketValues const>(packet);
+        appendf(
+          &segment->values_csv,
+          "%" PRId64 ",%.1f,%.1f,%.1f,%.2f,%.2f,%.2f,%.2f,%.3f,%.0f,%.4f,%.4f,%.4f,%.4f,%d,%d,%d,"
+          "%.6f,%d,%.1f,%.1f,%.1f,%.3f,%.3f\n",
+          stamp_ns, values->v_in(), values->temp_fet(), values->temp_motor(),
+          values->avg_motor_current(), values->avg_input_current(), values->avg_id(),
+          values->avg_iq(), values->duty_cycle_now(), values->rpm(), values->amp_hours(),
+          values->amp_hours_charged(), values->watt_hours(), values->watt_hours_charged(),
+          values->tachometer(), values->tachometer_abs(), values->fault_code(),
+          values->pid_pos_now(), values->controller_id(), values->temp_mos1(),
+          values->temp_mos2(), values->temp_mos3(), values->avg_vd(), values->avg_vq());
+        segment->values.push_back(
+          ValuesSample{stamp_ns, values->v_in(), values->avg_motor_current(),
+            values->avg_input_current(), values->watt_hours(), values->watt_hours_charged(),
+            values->tachometer_abs()});
+      } else if (packet->name() == "ImuData") {
+        auto imu = std::static_pointer_cast<VescPacketImu const>(packet);
+        appendf(
+          &segment->imu_csv,
+          "%" PRId64 ",%d,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,"
+          "%.6g,%.6g,%.6g,%.6g\n",
+          stamp_ns, imu->mask(), imu->roll(), imu->pitch(), imu->yaw(), imu->acc_x(),
+          imu->acc_y(), imu->acc_z(), imu->gyr_x(), imu->gyr_y(), imu->gyr_z(), imu->mag_x(),
+          imu->mag_y(), imu->mag_z(), imu->q_w(), imu->q_x(), imu->q_y(), imu->q_z());
+      }
+    },
+    [&](vesc_driver::VescErrorCode, std::size_t) {
+      segment->num_errors++;
+    });
+
+  // push chunk by chunk, so each packet is stamped with the chunk holding its last byte
+  auto chunk = std::upper_bound(
+    stream.chunk_end.begin(), stream.chunk_end.end(), segment->begin);
+  std::size_t offset = segment->begin;
+  while (offset < segment->end && chunk != stream.chunk_end.end()) {
+    const std::size_t end = std::min(*chunk, segment->end);
+    stamp_ns = stream.chunk_stamp[chunk - stream.chunk_end.begin()];
+    framer.push(stream.data + offset, end - offset, stamp_ns);
+    offset = end;
+    ++chunk;
+  }
+}
+
+double percentile(std::vector<double> * samples, double p)
+{
+  if (samples->empty()) {
+    return NAN;
+  }
+  auto nth = samples->begin() + static_cast<std::size_t>(p * (samples->size() - 1));
+  std::nth_element(samples->begin(), nth, samples->end());
+  return *nth;
+}
+
+/** Writes one aggregate row for the samples in [@p first, @p last). */
+void writeWindow(
+  FILE * file,
+  std::vector<ValuesSample>::const_iterator first,
+  std::vector<ValuesSample>::const_iterator last)
+{
+  const std::size_t n = std::distance(first, last);
+  std::vector<double> current_motor, current_input;
+  current_motor.reserve(n);
+  current_input.reserve(n);
+  double v_in_sum = 0.0, power_sum = 0.0;
+  for (auto it = first; it != last; ++it) {
+    current_motor.push_back(std::fabs(it->current_motor));
+    current_input.push_back(it->current_input);
+    v_in_sum += it->v_in;
+    power_sum += it->v_in * it->current_input;
+  }
+
+  const ValuesSample & a = *first;
+  const ValuesSample & b = *(last - 1);
+  const double energy_drawn = b.watt_hours - a.watt_hours;
+  const double energy_regen = b.watt_hours_charged - a.watt_hours_charged;
+  // windows end where the counters reset, so they only grow within a window
+  const int64_t distance = static_cast<int64_t>(b.tachometer_abs) - a.tachometer_abs;
+  const double net_energy = energy_drawn - energy_regen;
+
+  fprintf(
+    file, "%" PRId64 ",%" PRId64 ",%zu,%.2f,%.1f,%.2f,%.2f,%.2f,%.2f,%.2f,%.4f,%.4f,%.3f,%" PRId64
+    ",%.4f\n",
+    a.stamp_ns, b.stamp_ns, n, v_in_sum / n, power_sum / n,
+    percentile(&current_motor, 0.5), percentile(&current_motor, 0.95),
+    percentile(&current_motor, 1.0), percentile(&current_input, 0.5),
+    percentile(&current_input, 0.95), energy_drawn, energy_regen,
+    energy_drawn > 0.0 ? energy_regen / energy_drawn : 0.0, distance,
+    distance > 0 ? 1000.0 * net_energy / distance : 0.0);
+}
+
+/**
+ * @return true if the counters went backwards from @p a to @p b, i.e. the VESC restarted or they
+ *         were reset, so differences across the pair are meaningless.
+ */
+bool countersReset(const ValuesSample & a, const ValuesSample & b)
+{
+  return b.tachometer_abs < a.tachometer_abs;
+}
+
+void writeSummary(
+  FILE * file, const std::vector<ValuesSample> & values, double window_s,
+  std::size_t window_samples)
+{
+  fprintf(
+    file, "start_ns,end_ns,samples,v_in_mean,input_power_mean,current_motor_p50,"
+    "current_motor_p95,current_motor_max,current_input_p50,current_input_p95,energy_drawn,"
+    "energy_regen,regen_ratio,distance,wh_per_1000_counts\n");
+
+  const bool stamped = !values.empty() && values.front().stamp_ns >= 0;
+  const int64_t window_ns = static_cast<int64_t>(window_s * 1e9);
+  auto first = values.begin();
+  while (first != values.end()) {
+    const auto limit = stamped ? values.end() :
+      first + std::min<std::size_t>(window_samples, std::distance(first, values.end()));
+    auto last = first + 1;
+    while (last != limit && !countersReset(*(last - 1), *last) &&
+      (!stamped || last->stamp_ns - first->stamp_ns < window_ns))
+    {
+      ++last;
+    }
+    writeWindow(file, first, last);
+    first = last;
+  }
+}
+
+/**
+ * Closes an output file, reporting any write to it that failed.
+ *
+ * @return false if a write or the close failed.
+ */
+bool closeOutput(FILE * file, const std::string & path)
+{
+  // stdio keeps the error indicator set after a failed fwrite() or fprintf()
+  bool ok = ferror(file) == 0;
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    std::cerr << "Failed to write " << path << ": " << strerror(errno) << std::endl;
+  }
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  bool raw = false;
+  unsigned num_threads = std::max(1u, std::thread::hardware_concurrency());
+  double window_s = 1.0;
+  std::size_t window_samples = 50;
+  std::string prefix = "vesc";
+  int opt;
+  while ((opt = getopt(argc, argv, "bj:w:n:o:h")) != -1) {
+    switch (opt) {
+      case 'b': raw = true; break;
+      case 'j': num_threads = std::max(1, atoi(optarg)); break;
+      case 'w': window_s = atof(optarg); break;
+      case 'n': window_samples = std::max(1, atoi(optarg)); break;
+      case 'o': prefix = optarg; break;
+      default: usage(argv[0]); return opt == 'h' ? 0 : -1;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return -1;
+  }
+  const auto wall_start = std::chrono::steady_clock::now();
+
+  // gather the RX stream
+  Stream stream;
+  Buffer rx_bytes;
+  std::unique_ptr<vesc_driver::VescCaptureReader> reader;
+  void * raw_map = MAP_FAILED;
+  std::size_t raw_size = 0;
+  if (raw) {
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      std::cerr << "Failed to open " << argv[optind] << ": " << strerror(errno) << std::endl;
+      return -1;
+    }
+    raw_size = st.st_size;
+    if (raw_size > 0) {
+      raw_map = mmap(NULL, raw_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (raw_size > 0 && raw_map == MAP_FAILED) {
+      std::cerr << "Failed to map " << argv[optind] << ": " << strerror(errno) << std::endl;
+      return -1;
+    }
+    stream.data = static_cast<const uint8_t *>(raw_map);
+    stream.size = raw_size;
+    // no stamps, push in fixed-size chunks
+    for (std::size_t end = 0; end < raw_size; ) {
+      end = std::min(end + 4096, raw_size);
+      stream.chunk_end.push_back(end);
+      stream.chunk_stamp.push_back(-1);
+    }
+  } else {
+    try {
+      reader.reset(new vesc_driver::VescCaptureReader(argv[optind]));
+    } catch (const std::runtime_error & e) {
+      std::cerr << e.what() << std::endl;
+      return -1;
+    }
+    rx_bytes.reserve(reader->size());
+    vesc_driver::VescCaptureReader::Record record;
+    while (reader->next(&record)) {
+      if (record.direction == vesc_driver::CAPTURE_RX) {
+        rx_bytes.insert(rx_bytes.end(), record.data, record.data + record.size);
+        stream.chunk_end.push_back(rx_bytes.size());
+        stream.chunk_stamp.push_back(record.stamp_ns);
+      }
+    }
+    stream.data = rx_bytes.data();
+    stream.size = rx_bytes.size();
+  }
+
+  // split at frame boundaries, so each segment decodes independently
+  std::vector<Segment> segments(num_threads);
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < num_threads; i++) {
+    segments[i].begin = i == 0 ? 0 : findFrameBoundary(stream, stream.size * i / num_threads);
+  }
+  for (unsigned i = 0; i < num_threads; i++) {
+    segments[i].end = i + 1 < num_threads ? segments[i + 1].begin : stream.size;
+    segments[i].end = std::max(segments[i].begin, segments[i].end);
+    workers.emplace_back(decodeSegment, std::cref(stream), &segments[i]);
+  }
+  for (auto & worker : workers) {
+    worker.join();
+  }
+
+  // write results in stream order
+  const std::string values_path = prefix + "_values.csv";
+  const std::string imu_path = prefix + "_imu.csv";
+  const std::string summary_path = prefix + "_summary.csv";
+  FILE * values_file = fopen(values_path.c_str(), "w");
+  FILE * imu_file = fopen(imu_path.c_str(), "w");
+  FILE * summary_file = fopen(summary_path.c_str(), "w");
+  if (values_file == NULL || imu_file == NULL || summary_file == NULL) {
+    std::cerr << "Failed to open output files with prefix " << prefix << ": " <<
+      strerror(errno) << std::endl;
+    return -1;
+  }
+  fputs(VALUES_HEADER, values_file);
+  fputs(IMU_HEADER, imu_file);
+  uint64_t num_packets = 0, num_errors = 0;
+  std::vector<ValuesSample> values;
+  for (const auto & segment : segments) {
+    if (fwrite(segment.values_csv.data(), 1, segment.values_csv.size(), values_file) !=
+      segment.values_csv.size() ||
+      fwrite(segment.imu_csv.data(), 1, segment.imu_csv.size(), imu_file) !=
+      segment.imu_csv.size())
+    {
+      // the error indicator is set, closeOutput() reports it
+      break;
+    }
+    values.insert(values.end(), segment.values.begin(), segment.values.end());
+    num_packets += segment.num_packets;
+    num_errors += segment.num_errors;
+  }
+  writeSummary(summary_file, values, window_s, window_samples);
+  bool written = closeOutput(values_file, values_path);
+  written = closeOutput(imu_file, imu_path) && written;
+  written = closeOutput(summary_file, summary_path) && written;
+
+  if (raw_map != MAP_FAILED) {
+    munmap(raw_map, raw_size);
+  }
+
+  const double elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - wall_start).count();
+  fprintf(
+    stderr, "%" PRIu64 " packets, %" PRIu64 " errors, %zu bytes, %u threads in %.3f s\n",
+    num_packets, num_errors, stream.size, num_threads, elapsed);
+  return written ? 0 : -1;
+}
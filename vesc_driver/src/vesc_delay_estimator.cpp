@@ -0,0 +1,124 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_delay_estimator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace vesc_driver
+{
+
+namespace
+{
+
+/** Floor on the measurement variance, (10 us)^2, so the filter never stops listening. */
+const double MIN_MEASUREMENT_VARIANCE = 1e-10;
+
+/** Weight of a new sample in the jitter average, as in NTP. */
+const double JITTER_GAIN = 1.0 / 16.0;
+
+}  // namespace
+
+VescDelayEstimator::VescDelayEstimator(std::size_t filter_size, double process_noise)
+: filter_size_(std::max<std::size_t>(filter_size, 1)), process_noise_(process_noise)
+{
+  reset();
+}
+
+void VescDelayEstimator::update(int64_t stamp_ns, int64_t rtt_ns)
+{
+  if (rtt_ns < 0) {
+    return;
+  }
+  const double half_rtt = 0.5e-9 * rtt_ns;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  recent_.push_back(half_rtt);
+  if (recent_.size() > filter_size_) {
+    recent_.pop_front();
+  }
+  // the fastest recent exchange is the one least delayed by queueing
+  const double measurement = *std::min_element(recent_.begin(), recent_.end());
+
+  if (num_samples_ == 0) {
+    delay_ = measurement;
+    variance_ = measurement * measurement;
+    jitter2_ = 0.0;
+  } else {
+    // predict, the delay is modelled as a random walk
+    variance_ += process_noise_ * std::max<int64_t>(stamp_ns - last_stamp_ns_, 0) * 1e-9;
+
+    // correct, the minimum of n samples is about n times less noisy than one sample
+    const double measurement_variance =
+      std::max(jitter2_ / filter_size_, MIN_MEASUREMENT_VARIANCE);
+    const double gain = variance_ / (variance_ + measurement_variance);
+    delay_ += gain * (measurement - delay_);
+    variance_ *= 1.0 - gain;
+  }
+
+  const double deviation = half_rtt - delay_;
+  jitter2_ += JITTER_GAIN * (deviation * deviation - jitter2_);
+  last_stamp_ns_ = stamp_ns;
+  num_samples_++;
+}
+
+int64_t VescDelayEstimator::sampleStamp(int64_t rx_stamp_ns) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (num_samples_ == 0) {
+    return rx_stamp_ns;
+  }
+  return rx_stamp_ns - static_cast<int64_t>(delay_ * 1e9);
+}
+
+VescDelayEstimator::Estimate VescDelayEstimator::estimate() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  Estimate estimate;
+  estimate.num_samples = num_samples_;
+  estimate.delay = delay_;
+  estimate.uncertainty = std::sqrt(variance_);
+  estimate.jitter = std::sqrt(jitter2_);
+  return estimate;
+}
+
+void VescDelayEstimator::reset()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  recent_.clear();
+  num_samples_ = 0;
+  last_stamp_ns_ = 0;
+  delay_ = 0.0;
+  variance_ = 0.0;
+  jitter2_ = 0.0;
+}
+
+}  // namespace vesc_driver
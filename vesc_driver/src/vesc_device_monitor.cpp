@@ -0,0 +1,216 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_device_monitor.hpp"
+
+#include <fcntl.h>
+#include <libudev.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vesc_driver
+{
+
+VescDeviceMonitor::VescDeviceMonitor(
+  const DeviceAddedFunction & device_added,
+  const std::string & vendor_id,
+  const std::string & product_id)
+: device_added_(device_added),
+  vendor_id_(vendor_id),
+  product_id_(product_id),
+  udev_(NULL),
+  monitor_(NULL)
+{
+  if (pipe2(wake_pipe_, O_CLOEXEC) != 0) {
+    throw std::runtime_error(std::string("Failed to create pipe: ") + strerror(errno));
+  }
+  udev_ = udev_new();
+  if (udev_ != NULL) {
+    monitor_ = udev_monitor_new_from_netlink(udev_, "udev");
+  }
+  if (monitor_ == NULL ||
+    udev_monitor_filter_add_match_subsystem_devtype(monitor_, "tty", NULL) < 0 ||
+    udev_monitor_enable_receiving(monitor_) < 0)
+  {
+    if (monitor_ != NULL) {
+      udev_monitor_unref(monitor_);
+    }
+    if (udev_ != NULL) {
+      udev_unref(udev_);
+    }
+    ::close(wake_pipe_[0]);
+    ::close(wake_pipe_[1]);
+    throw std::runtime_error("Failed to set up the udev monitor");
+  }
+
+  thread_.reset(new std::thread(&VescDeviceMonitor::monitorThread, this));
+}
+
+VescDeviceMonitor::~VescDeviceMonitor()
+{
+  const char quit = 'q';
+  while (write(wake_pipe_[1], &quit, 1) < 0 && errno == EINTR) {}
+  thread_->join();
+  // no new probes start once the monitor thread is gone
+  for (auto & probe : probes_) {
+    probe.thread.join();
+  }
+  udev_monitor_unref(monitor_);
+  udev_unref(udev_);
+  ::close(wake_pipe_[0]);
+  ::close(wake_pipe_[1]);
+}
+
+void VescDeviceMonitor::rescan()
+{
+  const char request = 'r';
+  while (write(wake_pipe_[1], &request, 1) < 0 && errno == EINTR) {}
+}
+
+bool VescDeviceMonitor::matches(udev_device * device) const
+{
+  // the vendor and product are attributes of the USB device the port belongs to; the parent is
+  // owned by the child, so it is not unreferenced here
+  udev_device * usb = udev_device_get_parent_with_subsystem_devtype(device, "usb", "usb_device");
+  if (usb == NULL) {
+    return false;
+  }
+  const char * vendor = udev_device_get_sysattr_value(usb, "idVendor");
+  const char * product = udev_device_get_sysattr_value(usb, "idProduct");
+  return vendor != NULL && product != NULL && vendor_id_ == vendor && product_id_ == product;
+}
+
+std::vector<std::string> VescDeviceMonitor::presentDevices() const
+{
+  std::vector<std::string> devices;
+  udev_enumerate * enumerate = udev_enumerate_new(udev_);
+  if (enumerate == NULL) {
+    return devices;
+  }
+  udev_enumerate_add_match_subsystem(enumerate, "tty");
+  udev_enumerate_scan_devices(enumerate);
+  udev_list_entry * entry;
+  udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate)) {
+    udev_device * device = udev_device_new_from_syspath(udev_, udev_list_entry_get_name(entry));
+    if (device == NULL) {
+      continue;
+    }
+    const char * devnode = udev_device_get_devnode(device);
+    if (devnode != NULL && matches(device)) {
+      devices.push_back(devnode);
+    }
+    udev_device_unref(device);
+  }
+  udev_enumerate_unref(enumerate);
+  return devices;
+}
+
+void VescDeviceMonitor::report(const std::string & port)
+{
+  std::lock_guard<std::mutex> lock(probes_mutex_);
+  bool busy = false;
+  for (auto probe = probes_.begin(); probe != probes_.end(); ) {
+    if (probe->done) {
+      probe->thread.join();
+      probe = probes_.erase(probe);
+    } else {
+      busy = busy || probe->port == port;
+      ++probe;
+    }
+  }
+  if (busy) {
+    return;
+  }
+
+  probes_.emplace_back();
+  Probe * probe = &probes_.back();
+  probe->port = port;
+  probe->done = false;
+  probe->thread = std::thread(
+    [this, probe]() {
+      device_added_(probe->port);
+      std::lock_guard<std::mutex> lock(probes_mutex_);
+      probe->done = true;
+    });
+}
+
+void VescDeviceMonitor::monitorThread()
+{
+  struct pollfd fds[2];
+  fds[0].fd = udev_monitor_get_fd(monitor_);
+  fds[0].events = POLLIN;
+  fds[1].fd = wake_pipe_[0];
+  fds[1].events = POLLIN;
+
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+
+    if (fds[1].revents & POLLIN) {
+      char request;
+      if (read(wake_pipe_[0], &request, 1) == 1) {
+        if (request == 'q') {
+          return;
+        }
+        for (const auto & devnode : presentDevices()) {
+          report(devnode);
+        }
+      }
+    }
+
+    if (fds[0].revents & POLLIN) {
+      udev_device * device = udev_monitor_receive_device(monitor_);
+      if (device == NULL) {
+        continue;
+      }
+      const char * action = udev_device_get_action(device);
+      const char * devnode = udev_device_get_devnode(device);
+      if (action != NULL && strcmp(action, "add") == 0 && devnode != NULL && matches(device)) {
+        std::string port(devnode);
+        udev_device_unref(device);
+        report(port);
+      } else {
+        udev_device_unref(device);
+      }
+    }
+  }
+}
+
+}  // namespace vesc_driver
@@ -14,28 +14,116 @@
 # limitations under the License.
 */
 
+#include <glob.h>
 #include <unistd.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 #include <vesc_driver/vesc_device_uuid_lookup.hpp>
 
+namespace
+{
+
+/**
+ * @return The identity cache named by the VESC_IDENTITY_CACHE environment variable, or nullptr if
+ *         it is unset or cannot be opened, in which case every lookup opens its port.
+ */
+std::shared_ptr<vesc_driver::VescIdentityCache> openIdentityCache()
+{
+  const char * path = getenv("VESC_IDENTITY_CACHE");
+  if (path == nullptr || *path == '\0') {
+    return nullptr;
+  }
+  try {
+    return std::make_shared<vesc_driver::VescIdentityCache>(path);
+  } catch (const std::runtime_error & e) {
+    std::cerr << e.what() << std::endl;
+    return nullptr;
+  }
+}
+
+/** @return The serial ports matching @p pattern, e.g. /dev/ttyACM*. */
+std::vector<std::string> findPorts(const std::string & pattern)
+{
+  std::vector<std::string> ports;
+  glob_t matches;
+  if (glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+    for (std::size_t i = 0; i < matches.gl_pathc; ++i) {
+      ports.push_back(matches.gl_pathv[i]);
+    }
+  }
+  globfree(&matches);
+  return ports;
+}
+
+/**
+ * Probes every port matching @p pattern at once and prints one "<uuid> <port>" line per VESC that
+ * answers within @p timeout.
+ */
+int discover(
+  const std::string & pattern, std::chrono::milliseconds timeout,
+  const std::shared_ptr<vesc_driver::VescIdentityCache> & cache)
+{
+  // opening a port and sending the request is quick, the replies are awaited concurrently
+  std::vector<std::unique_ptr<vesc_driver::VescDeviceLookup>> lookups;
+  std::vector<std::string> ports = findPorts(pattern);
+  for (const auto & port : ports) {
+    lookups.emplace_back(new vesc_driver::VescDeviceLookup(port, cache, timeout));
+  }
+
+  // all lookups share one deadline
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  std::map<std::string, std::string> uuid_to_port;
+  for (std::size_t i = 0; i < lookups.size(); ++i) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+      deadline - std::chrono::steady_clock::now());
+    if (lookups[i]->waitReady(std::max(remaining, std::chrono::milliseconds(0)))) {
+      uuid_to_port[lookups[i]->deviceUUID()] = ports[i];
+    } else {
+      std::cerr << ports[i] << ": no VESC answered" << std::endl;
+    }
+  }
+
+  for (const auto & entry : uuid_to_port) {
+    std::cout << entry.first << " " << entry.second << std::endl;
+  }
+  return uuid_to_port.empty() ? -1 : 0;
+}
+
+}  // namespace
+
+/**
+ * Usage:
+ *   vesc_device_namer [device [timeout_ms]]   print the UUID of /dev/<device>, default ttyACM0
+ *   vesc_device_namer --discover [timeout_ms] print "<uuid> <port>" for every /dev/ttyACM* VESC
+ *
+ * If VESC_IDENTITY_CACHE names a cache file, ports already in it are answered without being opened.
+ */
 int main(int argc, char ** argv)
 {
   std::string devicePort = (argc > 1 ? argv[1] : "ttyACM0");
-  std::string maxRetry_ = (argc > 2 ? argv[2] : "50");
-  std::string VESC_UUID_ENV = "VESC_UUID_ENV=";
+  std::string timeout_ = (argc > 2 ? argv[2] : "1000");
+  std::chrono::milliseconds timeout(stoi(timeout_));
 
-  vesc_driver::VescDeviceLookup lookup("/dev/" + devicePort);
-  int maxRetry = stoi(maxRetry_);
-  for (int i = 0; i < maxRetry; i++) {
-    usleep(20);
-    if (lookup.isReady()) {break;}
+  std::shared_ptr<vesc_driver::VescIdentityCache> cache = openIdentityCache();
+
+  if (devicePort == "--discover") {
+    return discover("/dev/ttyACM*", timeout, cache);
   }
 
-  if (lookup.isReady()) {
+  std::string VESC_UUID_ENV = "VESC_UUID_ENV=";
+
+  // a cached answer is printed at once, the process exits once the VESC has confirmed it
+  vesc_driver::VescDeviceLookup lookup("/dev/" + devicePort, cache, timeout);
+  if (lookup.waitReady(timeout)) {
     VESC_UUID_ENV += lookup.deviceUUID();
 
     std::cout << lookup.deviceUUID() << std::endl;
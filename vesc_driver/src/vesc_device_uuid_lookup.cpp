@@ -13,13 +13,16 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 */
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <sstream>
 #include <iostream>
 #include <iomanip>
 #include <string>
 #include <memory>
+#include <mutex>
 
 #include "vesc_driver/vesc_device_uuid_lookup.hpp"
 
@@ -27,27 +30,76 @@
 namespace vesc_driver
 {
 using std::placeholders::_1;
+using std::placeholders::_2;
 
-VescDeviceLookup::VescDeviceLookup(std::string name)
+VescDeviceLookup::VescDeviceLookup(
+  std::string name,
+  std::shared_ptr<VescIdentityCache> cache,
+  std::chrono::milliseconds validation_timeout)
 : vesc_(
     std::string(),
     std::bind(&VescDeviceLookup::vescPacketCallback, this, _1),
-    std::bind(&VescDeviceLookup::vescErrorCallback, this, _1)
+    std::bind(&VescDeviceLookup::vescErrorCallback, this, _1, _2)
 ),
   ready_(false),
-  device_(name)
+  failed_(false),
+  from_cache_(false),
+  replied_(false),
+  validating_(false),
+  device_(name),
+  cache_(cache),
+  validation_deadline_(std::chrono::steady_clock::now() + validation_timeout)
 {
+  if (cache_) {
+    usb_serial_ = usbSerialNumber(device_);
+    if (cache_->find(usb_serial_, device_, &cached_identity_)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      hwname_ = cached_identity_.hwname;
+      version_ = std::to_string(cached_identity_.fw_major) + "." +
+        std::to_string(cached_identity_.fw_minor);
+      uuid_ = cached_identity_.uuidString();
+      ready_ = true;
+      from_cache_ = true;
+    }
+  }
+
   try {
     vesc_.connect(device_);
     vesc_.requestFWVersion();
   } catch (SerialException e) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (from_cache_) {
+      // the cached answer stands unchecked
+      return;
+    }
     std::cerr << "VESC error on port " << device_ << std::endl << e.what() << std::endl;
+    error_ = e.what();
+    failed_ = true;
     return;
   }
+  std::lock_guard<std::mutex> lock(mutex_);
+  validating_ = from_cache_;
+}
+
+VescDeviceLookup::~VescDeviceLookup()
+{
+  bool validating;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    validating = validating_;
+  }
+  if (validating) {
+    awaitReply(validation_deadline_, std::chrono::milliseconds(100));
+  }
+  vesc_.disconnect();
 }
 
 void VescDeviceLookup::close()
 {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    validating_ = false;
+  }
   vesc_.disconnect();
 }
 
@@ -58,39 +110,134 @@ void VescDeviceLookup::vescPacketCallback(const std::shared_ptr<VescPacket const
       std::dynamic_pointer_cast<VescPacketFWVersion const>(packet);
 
     const uint8_t * uuid = fw_version->uuid();
+    VescIdentity identity;
+    std::copy(uuid, uuid + identity.uuid.size(), identity.uuid.begin());
+    identity.hwname = fw_version->hwname();
+    identity.fw_major = fw_version->fwMajor();
+    identity.fw_minor = fw_version->fwMinor();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // retried requests can be answered more than once
+    if (replied_) {
+      return;
+    }
+    replied_ = true;
+    validating_ = false;
+    ready_condition_.notify_all();
 
-    hwname_ = fw_version->hwname();
-    version_ = fw_version->fwMajor() + "." + fw_version->fwMinor();
-    uuid_ += decode_uuid(uuid);
-    ready_ = true;
+    if (from_cache_) {
+      // the answer given from the cache may have been used already, only the entry is corrected
+      if (identity.uuid == cached_identity_.uuid && identity.hwname == cached_identity_.hwname &&
+        identity.fw_major == cached_identity_.fw_major &&
+        identity.fw_minor == cached_identity_.fw_minor)
+      {
+        return;
+      }
+      std::cerr << "Identity cache entry for " << device_ << " was stale, now VESC " <<
+        identity.uuidString() << std::endl;
+    } else {
+      hwname_ = identity.hwname;
+      version_ = std::to_string(identity.fw_major) + "." + std::to_string(identity.fw_minor);
+      uuid_ = identity.uuidString();
+      ready_ = true;
+    }
+
+    if (cache_) {
+      try {
+        cache_->store(usb_serial_, device_, identity);
+      } catch (const std::exception & e) {
+        std::cerr << "Failed to cache identity of " << device_ << ": " << e.what() << std::endl;
+      }
+    }
   }
 }
 
-void VescDeviceLookup::vescErrorCallback(const std::string & error)
+void VescDeviceLookup::vescErrorCallback(VescErrorCode error, std::size_t /*num_bytes*/)
 {
-  error_ = error;
-  ready_ = false;
+  // garbage on the line, e.g. left over from before the port was opened, does not invalidate a
+  // reply that was already received
+  std::lock_guard<std::mutex> lock(mutex_);
+  error_ = vescErrorString(error);
 }
 
 bool VescDeviceLookup::isReady()
 {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return ready_;
+}
+
+bool VescDeviceLookup::waitReady(
+  std::chrono::milliseconds timeout,
+  std::chrono::milliseconds retry_period)
+{
+  {
+    // answered from the cache
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ready_) {
+      return true;
+    }
+  }
+  awaitReply(std::chrono::steady_clock::now() + timeout, retry_period);
+  std::lock_guard<std::mutex> lock(mutex_);
   return ready_;
 }
 
+void VescDeviceLookup::awaitReply(
+  std::chrono::steady_clock::time_point deadline, std::chrono::milliseconds retry_period)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!replied_ && !failed_) {
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      break;
+    }
+    if (ready_condition_.wait_until(lock, std::min(deadline, now + retry_period), [this]() {
+        return replied_;
+      }))
+    {
+      break;
+    }
+    if (std::chrono::steady_clock::now() < deadline) {
+      lock.unlock();
+      try {
+        vesc_.requestFWVersion();
+      } catch (const SerialException &) {
+        // a failed write is not final, keep trying until the deadline
+      }
+      lock.lock();
+    }
+  }
+}
+
 const char * VescDeviceLookup::deviceUUID() const
 {
+  std::lock_guard<std::mutex> lock(mutex_);
   return uuid_.c_str();
 }
 
 
 const char * VescDeviceLookup::version() const
 {
+  std::lock_guard<std::mutex> lock(mutex_);
   return version_.c_str();
 }
 
 const char * VescDeviceLookup::hwname() const
 {
+  std::lock_guard<std::mutex> lock(mutex_);
   return hwname_.c_str();
 }
 
+const char * VescDeviceLookup::error() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return error_.c_str();
+}
+
+bool VescDeviceLookup::fromCache() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return from_cache_;
+}
+
 }  // namespace vesc_driver
@@ -30,51 +30,207 @@
 
 #include "vesc_driver/vesc_driver.hpp"
 
+#include <diagnostic_msgs/msg/diagnostic_status.hpp>
+#include <lifecycle_msgs/msg/state.hpp>
 #include <vesc_msgs/msg/vesc_state.hpp>
 #include <vesc_msgs/msg/vesc_state_stamped.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cmath>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_capture.hpp"
+#include "vesc_driver/vesc_device_uuid_lookup.hpp"
+#include "vesc_driver/vesc_tracing.hpp"
 
 namespace vesc_driver
 {
 
 using namespace std::chrono_literals;
 using std::placeholders::_1;
+
+namespace
+{
+
+/** Reads a double or integer parameter @p value into @p number. @return false for other types. */
+bool parameterAsDouble(const rclcpp::ParameterValue & value, double * number)
+{
+  if (value.get_type() == rclcpp::ParameterType::PARAMETER_DOUBLE) {
+    *number = value.get<double>();
+  } else if (value.get_type() == rclcpp::ParameterType::PARAMETER_INTEGER) {
+    *number = static_cast<double>(value.get<int64_t>());
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
 using std_msgs::msg::Float64;
 using vesc_msgs::msg::VescStateStamped;
 using sensor_msgs::msg::Imu;
 
 VescDriver::VescDriver(const rclcpp::NodeOptions & options)
-: rclcpp::Node("vesc_driver", options),
+: rclcpp_lifecycle::LifecycleNode("vesc_driver", options),
   vesc_(
     std::string(),
-    std::bind(&VescDriver::vescPacketCallback, this, _1),
-    std::bind(&VescDriver::vescErrorCallback, this, _1)),
+    std::bind(&VescDriver::vescPacketCallback, this, _1)),
   duty_cycle_limit_(this, "duty_cycle", -1.0, 1.0),
   current_limit_(this, "current"),
   brake_limit_(this, "brake"),
   speed_limit_(this, "speed"),
   position_limit_(this, "position"),
   servo_limit_(this, "servo", 0.0, 1.0),
-  driver_mode_(MODE_INITIALIZING),
+  driver_mode_(MODE_INACTIVE),
+  buffer_commands_(false),
+  pending_commands_(),
   fw_version_major_(-1),
-  fw_version_minor_(-1)
+  fw_version_minor_(-1),
+  imu_mask_(IMU_MASK_ALL),
+  stamp_sample_time_(false),
+  last_error_counts_(),
+  speed_to_erpm_gain_(0.0),
+  speed_to_erpm_offset_(0.0),
+  steering_to_servo_gain_(0.0),
+  steering_to_servo_offset_(0.0),
+  timeout_brake_current_(0.0),
+  command_timed_out_(false),
+  num_command_timeouts_(0),
+  num_stale_commands_(0),
+  reconnect_(true),
+  reconnect_initial_delay_(0.05),
+  reconnect_max_delay_(2.0),
+  reconnect_delay_(0.05),
+  verify_uuid_(false),
+  device_uuid_(),
+  have_device_uuid_(false),
+  uuid_mismatch_(false),
+  reconnect_pending_(false),
+  num_reconnects_(0),
+  last_reconnect_latency_ns_(-1),
+  have_cached_identity_(false),
+  confirm_cached_identity_(false),
+  uuid_lookup_timeout_(1.0),
+  searching_(false),
+  read_mcconf_(false),
+  refresh_mcconf_(false),
+  use_mcconf_limits_(false),
+  mcconf_(),
+  mcconf_fw_major_(-1),
+  mcconf_fw_minor_(-1),
+  mcconf_from_disk_(false),
+  mcconf_wanted_(false),
+  mcconf_changed_(false),
+  updater_(this),
+  min_poll_frequency_(50.0),
+  max_poll_frequency_(50.0),
+  fault_code_(-1),
+  last_diagnostic_error_counts_(),
+  last_diagnostic_time_(std::chrono::steady_clock::now())
 {
-  // get vesc serial port address
-  std::string port = declare_parameter<std::string>("port", "");
+  // parameters are declared up front so they can be set before the node is configured; most are
+  // read on configure
+  declare_parameter<std::string>("port", "");
+  declare_parameter<std::string>("uuid", "");
+  declare_parameter<double>("uuid_lookup_timeout", 1.0);
+  declare_parameter<std::string>("record_path", "");
+  declare_parameter<bool>("stamp_sample_time", false);
+  declare_parameter<int64_t>("tx_batch_window_us", 0);
+  declare_parameter<double>("command_timeout", 0.0);
+  declare_parameter<double>("timeout_brake_current", 0.0);
+  declare_parameter<int64_t>("imu_mask", IMU_MASK_ALL);
+  declare_parameter<bool>("use_ackermann_cmd", false);
+  declare_parameter<double>("speed_to_erpm_gain", 0.0);
+  declare_parameter<double>("speed_to_erpm_offset", 0.0);
+  declare_parameter<double>("steering_angle_to_servo_gain", 0.0);
+  declare_parameter<double>("steering_angle_to_servo_offset", 0.0);
+  declare_parameter<double>("error_report_period", 1.0);
+  declare_parameter<double>("keepalive_period", 0.0);
+  declare_parameter<bool>("reconnect", true);
+  declare_parameter<double>("reconnect_initial_delay", 0.05);
+  declare_parameter<double>("reconnect_max_delay", 2.0);
+  declare_parameter<bool>("verify_uuid", false);
+  declare_parameter<double>("handshake_retry_period", 0.01);
+  declare_parameter<bool>("buffer_commands_during_init", false);
+  declare_parameter<std::string>("identity_cache", "");
+  declare_parameter<bool>("read_mcconf", false);
+  declare_parameter<std::string>("mcconf_cache_dir", "");
+  declare_parameter<bool>("mcconf_refresh", false);
+  declare_parameter<bool>("use_mcconf_limits", false);
 
-  // attempt to connect to the serial port
-  try {
-    vesc_.connect(port);
-  } catch (SerialException e) {
-    RCLCPP_FATAL(get_logger(), "Failed to connect to the VESC, %s.", e.what());
-    rclcpp::shutdown();
-    return;
+  // report link and controller health on /diagnostics
+  state_frequency_.reset(
+    new diagnostic_updater::FrequencyStatus(
+      diagnostic_updater::FrequencyStatusParam(&min_poll_frequency_, &max_poll_frequency_),
+      "State poll frequency"));
+  imu_frequency_.reset(
+    new diagnostic_updater::FrequencyStatus(
+      diagnostic_updater::FrequencyStatusParam(&min_poll_frequency_, &max_poll_frequency_),
+      "IMU poll frequency"));
+  updater_.add(*state_frequency_);
+  updater_.add("Serial link", this, &VescDriver::linkDiagnostics);
+  updater_.add("Motor controller", this, &VescDriver::controllerDiagnostics);
+
+  // command limits can be tuned while running; changes are validated before they are set and
+  // applied after
+  parameters_callback_handle_ = add_on_set_parameters_callback(
+    std::bind(&VescDriver::parametersCallback, this, _1));
+#if RCLCPP_VERSION_GTE(21, 0, 0)
+  parameters_set_callback_handle_ = add_post_set_parameters_callback(
+    std::bind(&VescDriver::parametersSetCallback, this, _1));
+#endif
+
+  // without a lifecycle manager, bring the node up as soon as the executor spins
+  if (declare_parameter<bool>("autostart", true)) {
+    autostart_timer_ = create_wall_timer(
+      0ms, [this]() {
+        autostart_timer_->cancel();
+        if (configure().id() != lifecycle_msgs::msg::State::PRIMARY_STATE_INACTIVE ||
+        activate().id() != lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE)
+        {
+          RCLCPP_FATAL(get_logger(), "Failed to start the driver.");
+          rclcpp::shutdown();
+        }
+      });
+  }
+}
+
+VescDriver::CallbackReturn VescDriver::on_configure(const rclcpp_lifecycle::State &)
+{
+  // telemetry is stamped with the time it was read from the serial port, or optionally with the
+  // time the VESC sampled it as estimated from request round trips
+  stamp_sample_time_ = get_parameter("stamp_sample_time").as_bool();
+
+  // optionally coalesce frames sent within this many microseconds into one serial write
+  int64_t tx_batch_window_us = get_parameter("tx_batch_window_us").as_int();
+  vesc_.setTxBatchWindow(std::chrono::microseconds(tx_batch_window_us));
+
+  // stop the motor if no motor command arrives within command_timeout seconds, by releasing it or,
+  // if timeout_brake_current is set, braking with that current
+  command_watchdog_.setTimeout(get_parameter("command_timeout").as_double());
+  timeout_brake_current_ = get_parameter("timeout_brake_current").as_double();
+
+  // IMU fields to request, see VescImuMask; 0 disables IMU polling
+  int64_t imu_mask = get_parameter("imu_mask").as_int();
+  if (imu_mask < 0 || imu_mask > IMU_MASK_ALL) {
+    RCLCPP_WARN(
+      get_logger(), "Parameter imu_mask (%ld) is not a 16 bit mask, requesting all fields.",
+      static_cast<long>(imu_mask));
+    imu_mask = IMU_MASK_ALL;
+  }
+  imu_mask_ = static_cast<uint16_t>(imu_mask);
+  // the IMU poll rate is only monitored while the IMU is polled, otherwise it would always warn
+  updater_.removeByName(imu_frequency_->getName());
+  if (imu_mask_ != 0) {
+    updater_.add(*imu_frequency_);
   }
 
   // create vesc state (telemetry) publisher
@@ -103,8 +259,264 @@ VescDriver::VescDriver(const rclcpp::NodeOptions & options)
   servo_sub_ = create_subscription<Float64>(
     "commands/servo/position", rclcpp::QoS{10}, std::bind(&VescDriver::servoCallback, this, _1));
 
+  // optionally take ackermann commands directly, converting them here rather than in a separate
+  // ackermann_to_vesc node so speed and steering go out together in a single serial write
+  if (get_parameter("use_ackermann_cmd").as_bool()) {
+    speed_to_erpm_gain_ = get_parameter("speed_to_erpm_gain").as_double();
+    speed_to_erpm_offset_ = get_parameter("speed_to_erpm_offset").as_double();
+    steering_to_servo_gain_ = get_parameter("steering_angle_to_servo_gain").as_double();
+    steering_to_servo_offset_ = get_parameter("steering_angle_to_servo_offset").as_double();
+    ackermann_sub_ = create_subscription<AckermannDriveStamped>(
+      "ackermann_cmd", rclcpp::QoS{10}, std::bind(&VescDriver::ackermannCmdCallback, this, _1));
+  }
+
+  // if the link fails, e.g. when the USB device re-enumerates, reopen the port with exponential
+  // backoff and optionally check that the same VESC comes back
+  reconnect_ = get_parameter("reconnect").as_bool();
+  reconnect_initial_delay_ = get_parameter("reconnect_initial_delay").as_double();
+  reconnect_max_delay_ = std::max(
+    get_parameter("reconnect_max_delay").as_double(), reconnect_initial_delay_);
+  verify_uuid_ = get_parameter("verify_uuid").as_bool();
+
+  // optionally keep the latest commands received before the handshake completes and send them as
+  // soon as it does, rather than dropping them
+  buffer_commands_ = get_parameter("buffer_commands_during_init").as_bool();
+
+  // optionally remember which VESC is behind the port across runs; if it is known, the first
+  // activation holds commands until the version reply confirms it and sends them right away,
+  // rather than dropping them as the handshake otherwise does
+  std::string identity_cache_path = get_parameter("identity_cache").as_string();
+  if (!identity_cache_path.empty()) {
+    try {
+      identity_cache_ = std::make_shared<VescIdentityCache>(identity_cache_path);
+    } catch (const std::runtime_error & e) {
+      RCLCPP_WARN(get_logger(), "Not using the identity cache, %s.", e.what());
+    }
+  }
+
+  // either open the configured port, or find the VESC with the configured UUID among the USB
+  // serial ports and keep watching for it, so it is attached wherever it is plugged in
+  port_ = get_parameter("port").as_string();
+  uuid_ = get_parameter("uuid").as_string();
+  std::transform(uuid_.begin(), uuid_.end(), uuid_.begin(), ::tolower);
+  if (!uuid_.empty()) {
+    uuid_lookup_timeout_ = get_parameter("uuid_lookup_timeout").as_double();
+    try {
+      device_monitor_.reset(
+        new VescDeviceMonitor(std::bind(&VescDriver::deviceAdded, this, std::placeholders::_1)));
+    } catch (const std::runtime_error & e) {
+      RCLCPP_ERROR(get_logger(), "Failed to watch for the VESC, %s.", e.what());
+      releaseResources();
+      return CallbackReturn::FAILURE;
+    }
+    searchDevice();
+    std::unique_lock<std::mutex> lock(found_port_mutex_);
+    found_port_condition_.wait_for(
+      lock, std::chrono::duration<double>(uuid_lookup_timeout_),
+      [this]() {return !found_port_.empty();});
+    port_.swap(found_port_);
+    found_port_.clear();
+    if (port_.empty() && !reconnect_) {
+      lock.unlock();
+      RCLCPP_ERROR(get_logger(), "VESC %s not found.", uuid_.c_str());
+      releaseResources();
+      return CallbackReturn::FAILURE;
+    } else if (port_.empty()) {
+      RCLCPP_WARN(
+        get_logger(), "VESC %s not found, attaching to it once it is plugged in.", uuid_.c_str());
+    } else {
+      RCLCPP_INFO(get_logger(), "Found VESC %s on %s.", uuid_.c_str(), port_.c_str());
+    }
+  }
+
+  if (identity_cache_ && !port_.empty()) {
+    usb_serial_ = usbSerialNumber(port_);
+    have_cached_identity_ = identity_cache_->find(usb_serial_, port_, &cached_identity_);
+    confirm_cached_identity_ = have_cached_identity_;
+    if (have_cached_identity_) {
+      RCLCPP_INFO(
+        get_logger(), "VESC %s (%s, firmware %d.%d) on %s known from the identity cache.",
+        cached_identity_.uuidString().c_str(), cached_identity_.hwname.c_str(),
+        cached_identity_.fw_major, cached_identity_.fw_minor, port_.c_str());
+    }
+  }
+
+  // optionally read the VESC's motor configuration, to narrow the command limits to it and derive
+  // the ackermann speed gain from it; copies are kept on disk by UUID, and only read again when
+  // the firmware, and with it the configuration layout, changes
+  read_mcconf_ = get_parameter("read_mcconf").as_bool();
+  refresh_mcconf_ = get_parameter("mcconf_refresh").as_bool();
+  use_mcconf_limits_ = get_parameter("use_mcconf_limits").as_bool();
+  std::string mcconf_cache_dir = get_parameter("mcconf_cache_dir").as_string();
+  if (read_mcconf_ && !mcconf_cache_dir.empty()) {
+    conf_cache_.reset(new VescConfCache(mcconf_cache_dir));
+  }
+
+  // connect last, received packets are published from the moment the read thread starts
+  if (uuid_.empty() || !port_.empty()) {
+    try {
+      vesc_.connect(port_);
+    } catch (SerialException e) {
+      RCLCPP_ERROR(get_logger(), "Failed to connect to the VESC, %s.", e.what());
+      releaseResources();
+      return CallbackReturn::FAILURE;
+    }
+  }
+  updater_.setHardwareID(uuid_.empty() ? port_ : uuid_);
+
+  // optionally capture the raw serial stream, for replay with vesc_replay
+  std::string record_path = get_parameter("record_path").as_string();
+  if (!record_path.empty()) {
+    try {
+      vesc_.startRecording(record_path);
+      RCLCPP_INFO(get_logger(), "Recording serial stream to %s", record_path.c_str());
+    } catch (const std::runtime_error & e) {
+      RCLCPP_ERROR(get_logger(), "Failed to start recording, %s.", e.what());
+    }
+  }
+
+  return CallbackReturn::SUCCESS;
+}
+
+VescDriver::CallbackReturn VescDriver::on_activate(const rclcpp_lifecycle::State &)
+{
+  state_pub_->on_activate();
+  imu_pub_->on_activate();
+  imu_std_pub_->on_activate();
+  servo_sensor_pub_->on_activate();
+
+  // commands are accepted once the firmware version handshake completes, which happens as soon as
+  // the reply arrives; the request is repeated until then
+  fw_version_major_ = -1;
+  fw_version_minor_ = -1;
+  command_watchdog_.reset();
+  command_timed_out_ = false;
+  if (!vesc_.isConnected()) {
+    // attaching by UUID and the VESC is not plugged in yet, or the link failed since configuring
+    confirm_cached_identity_ = false;
+    driver_mode_ = MODE_RECONNECTING;
+    reconnect_delay_ = reconnect_initial_delay_;
+    next_reconnect_time_ = std::chrono::steady_clock::now();
+  } else {
+    driver_mode_ = MODE_INITIALIZING;
+  }
+  if (driver_mode_ != MODE_RECONNECTING) {
+    trySend([this]() {vesc_.requestFWVersion();});
+  }
+  // reconnects reuse the timer, it cancels itself while not initializing
+  double handshake_retry_period = get_parameter("handshake_retry_period").as_double();
+  handshake_timer_ = create_wall_timer(
+    std::chrono::duration<double>(handshake_retry_period),
+    std::bind(&VescDriver::handshakeCallback, this));
+
   // create a 50Hz timer, used for state machine & polling VESC telemetry
   timer_ = create_wall_timer(20ms, std::bind(&VescDriver::timerCallback, this));
+
+  // serial errors are counted by the interface and reported in aggregate, at most once per period
+  double error_report_period = get_parameter("error_report_period").as_double();
+  error_report_timer_ = create_wall_timer(
+    std::chrono::duration<double>(error_report_period),
+    std::bind(&VescDriver::errorReportCallback, this));
+
+  // optionally reset the VESC's own command timeout at a fixed rate, so that it only trips if this
+  // driver or the serial link dies and can be set much tighter than the command rate allows; only
+  // while commands arrive within command_timeout, or a stalled planner's last command would run on
+  double keepalive_period = get_parameter("keepalive_period").as_double();
+  if (keepalive_period > 0.0 && !command_watchdog_.enabled()) {
+    RCLCPP_WARN(get_logger(), "keepalive_period needs a command_timeout, not sending keepalives.");
+  } else if (keepalive_period > 0.0) {
+    keepalive_timer_ = create_wall_timer(
+      std::chrono::duration<double>(keepalive_period),
+      std::bind(&VescDriver::keepaliveCallback, this));
+  }
+
+  return CallbackReturn::SUCCESS;
+}
+
+VescDriver::CallbackReturn VescDriver::on_deactivate(const rclcpp_lifecycle::State &)
+{
+  timer_.reset();
+  error_report_timer_.reset();
+  keepalive_timer_.reset();
+  handshake_timer_.reset();
+
+  // stop forwarding commands and leave the motor released rather than on its last command
+  driver_mode_ = MODE_INACTIVE;
+  confirm_cached_identity_ = false;
+  discardPendingCommands();
+  if (vesc_.isConnected()) {
+    try {
+      vesc_.setCurrent(0.0);
+    } catch (const SerialException & e) {
+      RCLCPP_WARN(get_logger(), "Failed to release the motor, %s.", e.what());
+    }
+  }
+
+  state_pub_->on_deactivate();
+  imu_pub_->on_deactivate();
+  imu_std_pub_->on_deactivate();
+  servo_sensor_pub_->on_deactivate();
+
+  return CallbackReturn::SUCCESS;
+}
+
+VescDriver::CallbackReturn VescDriver::on_cleanup(const rclcpp_lifecycle::State &)
+{
+  releaseResources();
+  return CallbackReturn::SUCCESS;
+}
+
+VescDriver::CallbackReturn VescDriver::on_shutdown(const rclcpp_lifecycle::State &)
+{
+  releaseResources();
+  return CallbackReturn::SUCCESS;
+}
+
+void VescDriver::releaseResources()
+{
+  // the monitor thread probes ports and uses the identity cache, stop it first
+  device_monitor_.reset();
+  searching_ = false;
+  {
+    std::lock_guard<std::mutex> lock(found_port_mutex_);
+    found_port_.clear();
+  }
+  timer_.reset();
+  error_report_timer_.reset();
+  keepalive_timer_.reset();
+  handshake_timer_.reset();
+  driver_mode_ = MODE_INACTIVE;
+  discardPendingCommands();
+
+  // the read thread publishes, so stop it before the publishers go away
+  vesc_.disconnect();
+  try {
+    vesc_.stopRecording();
+  } catch (const std::runtime_error & e) {
+    RCLCPP_ERROR(get_logger(), "Serial capture is incomplete, %s.", e.what());
+  }
+  reportRecordingError();
+  have_device_uuid_ = false;
+  uuid_mismatch_ = false;
+  reconnect_pending_ = false;
+  identity_cache_.reset();
+  have_cached_identity_ = false;
+  conf_cache_.reset();
+  mcconf_wanted_ = false;
+  mcconf_changed_ = false;
+  confirm_cached_identity_ = false;
+
+  duty_cycle_sub_.reset();
+  current_sub_.reset();
+  brake_sub_.reset();
+  speed_sub_.reset();
+  position_sub_.reset();
+  servo_sub_.reset();
+  ackermann_sub_.reset();
+  state_pub_.reset();
+  imu_pub_.reset();
+  imu_std_pub_.reset();
+  servo_sensor_pub_.reset();
 }
 
 /* TODO or TO-THINKABOUT LIST
@@ -113,41 +525,66 @@ VescDriver::VescDriver(const rclcpp::NodeOptions & options)
   - check version number against know compatable?
   - should we wait until we receive telemetry before sending commands?
   - should we track the last motor command
-  - what to do if no motor command received recently?
   - what to do if no servo command received recently?
   - what is the motor safe off state (0 current?)
   - what to do if a command parameter is out of range, ignore?
   - try to predict vesc bounds (from vesc config) and command detect bounds errors
 */
 
+template<typename SendFunction>
+void VescDriver::trySend(SendFunction && send)
+{
+  try {
+    send();
+  } catch (const SerialException & e) {
+    auto & clk = *get_clock();
+    RCLCPP_WARN_THROTTLE(get_logger(), clk, 1000, "%s", e.what());
+  }
+}
+
 void VescDriver::timerCallback()
 {
-  // VESC interface should not unexpectedly disconnect, but test for it anyway
-  if (!vesc_.isConnected()) {
-    RCLCPP_FATAL(get_logger(), "Unexpectedly disconnected from serial port.");
-    rclcpp::shutdown();
+  if (driver_mode_ == MODE_RECONNECTING) {
+    reconnect();
+    return;
+  }
+
+  // the serial link can fail, e.g. when a USB device re-enumerates after interference, and the
+  // version reply can reveal that the port leads to another VESC than the one wanted
+  if (!vesc_.isConnected() || uuid_mismatch_) {
+    uuid_mismatch_ = false;
+    linkLost();
     return;
   }
 
   /*
    * Driver state machine, modes:
-   *  INITIALIZING - request and wait for vesc version
+   *  INACTIVE - lifecycle node not active
+   *  INITIALIZING - request and wait for vesc version, see handshakeCallback()
    *  OPERATING - receiving commands from subscriber topics
+   *  RECONNECTING - waiting to reopen the serial port after the link failed
    */
   if (driver_mode_ == MODE_INITIALIZING) {
-    // request version number, return packet will update the internal version numbers
-    vesc_.requestFWVersion();
-    if (fw_version_major_ >= 0 && fw_version_minor_ >= 0) {
-      RCLCPP_INFO(
-        get_logger(), "Connected to VESC with firmware version %d.%d",
-        fw_version_major_, fw_version_minor_);
-      driver_mode_ = MODE_OPERATING;
-    }
+    // nothing to poll yet, the version reply itself completes the handshake
   } else if (driver_mode_ == MODE_OPERATING) {
+    if (mcconf_changed_.exchange(false)) {
+      applyMcConf();
+    }
+
+    // send all polls in a single serial write
+    VescInterface::TxBatch batch(vesc_);
+    checkCommandDeadline();
+    // the configuration is large and rarely lost, so it is requested again only once a second
+    if (mcconf_wanted_ && std::chrono::steady_clock::now() >= next_mcconf_request_) {
+      vesc_.requestMcConf();
+      next_mcconf_request_ = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    }
     // poll for vesc state (telemetry)
     vesc_.requestState();
     // poll for vesc imu
-    vesc_.requestImuData();
+    if (imu_mask_ != 0) {
+      vesc_.requestImuData(imu_mask_);
+    }
   } else {
     // unknown mode, how did that happen?
     assert(false && "unknown driver mode");
@@ -156,12 +593,13 @@ void VescDriver::timerCallback()
 
 void VescDriver::vescPacketCallback(const std::shared_ptr<VescPacket const> & packet)
 {
-  if (packet->name() == "Values") {
+  // late replies may still arrive after deactivation, they are not published
+  if (packet->name() == "Values" && state_pub_->is_activated()) {
     std::shared_ptr<VescPacketValues const> values =
       std::dynamic_pointer_cast<VescPacketValues const>(packet);
 
     auto state_msg = VescStateStamped();
-    state_msg.header.stamp = now();
+    state_msg.header.stamp = packetStamp(*packet);
 
     state_msg.state.voltage_input = values->v_in();
     state_msg.state.current_motor = values->avg_motor_current();
@@ -189,10 +627,54 @@ void VescDriver::vescPacketCallback(const std::shared_ptr<VescPacket const> & pa
     state_msg.state.avg_vq = values->avg_vq();
 
     state_pub_->publish(state_msg);
+    VESC_TRACEPOINT(packet_published, packet->sequence(), "sensors/core");
+    state_frequency_->tick();
+    fault_code_ = values->fault_code();
   } else if (packet->name() == "FWVersion") {
     std::shared_ptr<VescPacketFWVersion const> fw_version =
       std::dynamic_pointer_cast<VescPacketFWVersion const>(packet);
-    // todo: might need lock here
+    VescIdentity identity;
+    std::copy(
+      fw_version->uuid(), fw_version->uuid() + identity.uuid.size(), identity.uuid.begin());
+    identity.hwname = fw_version->hwname();
+    identity.fw_major = fw_version->fwMajor();
+    identity.fw_minor = fw_version->fwMinor();
+    // commands held on the strength of the cache are only for the VESC it names; another one, e.g.
+    // after swapping controllers, gets the usual handshake without them
+    if (confirm_cached_identity_ && !isCachedIdentity(identity)) {
+      confirm_cached_identity_ = false;
+      if (!buffer_commands_) {
+        RCLCPP_WARN(
+          get_logger(), "The VESC on %s is not the one in the identity cache, dropping the "
+          "commands held for it.", port_.c_str());
+        discardPendingCommands();
+      }
+    }
+    // the cache records whatever answers on the port, even if it is not the VESC wanted
+    if (identity_cache_) {
+      updateIdentityCache(identity);
+    }
+    if (!uuid_.empty() && identity.uuidString() != uuid_) {
+      RCLCPP_ERROR(
+        get_logger(), "The VESC on %s is %s rather than %s, ignoring it.", port_.c_str(),
+        identity.uuidString().c_str(), uuid_.c_str());
+      uuid_mismatch_ = true;
+      return;
+    }
+    // optionally refuse to resume with a different VESC than the one seen first
+    if (verify_uuid_) {
+      const uint8_t * uuid = fw_version->uuid();
+      if (!have_device_uuid_) {
+        std::copy(uuid, uuid + device_uuid_.size(), device_uuid_.begin());
+        have_device_uuid_ = true;
+      } else if (!std::equal(device_uuid_.begin(), device_uuid_.end(), uuid)) {
+        RCLCPP_ERROR(
+          get_logger(), "The VESC on %s is not the one connected before, ignoring it.",
+          port_.c_str());
+        uuid_mismatch_ = true;
+        return;
+      }
+    }
     fw_version_major_ = fw_version->fwMajor();
     fw_version_minor_ = fw_version->fwMinor();
     RCLCPP_INFO(
@@ -201,52 +683,86 @@ void VescDriver::vescPacketCallback(const std::shared_ptr<VescPacket const> & pa
       fw_version->hwname().c_str(),
       fw_version->paired()
     );
-  } else if (packet->name() == "ImuData") {
+    if (driver_mode_ == MODE_INITIALIZING) {
+      handshakeComplete();
+    }
+    // confirmed, later handshakes drop commands as usual
+    confirm_cached_identity_ = false;
+    if (read_mcconf_) {
+      vesc_identity_ = identity;
+      loadMcConf();
+    }
+  } else if (packet->name() == "McConf") {
+    if (mcconf_wanted_) {
+      mcConfReceived(*std::dynamic_pointer_cast<VescPacketMcConf const>(packet));
+    }
+  } else if (packet->name() == "ImuData" && imu_pub_->is_activated()) {
     std::shared_ptr<VescPacketImu const> imuData =
       std::dynamic_pointer_cast<VescPacketImu const>(packet);
 
     auto imu_msg = VescImuStamped();
     auto std_imu_msg = Imu();
-    imu_msg.header.stamp = now();
-    std_imu_msg.header.stamp = now();
-
-    imu_msg.imu.ypr.x = imuData->roll();
-    imu_msg.imu.ypr.y = imuData->pitch();
-    imu_msg.imu.ypr.z = imuData->yaw();
+    imu_msg.header.stamp = packetStamp(*packet);
+    std_imu_msg.header.stamp = imu_msg.header.stamp;
 
-    imu_msg.imu.linear_acceleration.x = imuData->acc_x();
-    imu_msg.imu.linear_acceleration.y = imuData->acc_y();
-    imu_msg.imu.linear_acceleration.z = imuData->acc_z();
+    // only the fields selected by imu_mask are sent by the VESC, the others are left unset; in
+    // sensor_msgs/Imu a covariance of -1 marks a missing estimate
+    const int mask = imuData->mask();
+    if (mask & IMU_MASK_RPY) {
+      imu_msg.imu.ypr.x = imuData->roll();
+      imu_msg.imu.ypr.y = imuData->pitch();
+      imu_msg.imu.ypr.z = imuData->yaw();
+    }
 
-    imu_msg.imu.angular_velocity.x = imuData->gyr_x();
-    imu_msg.imu.angular_velocity.y = imuData->gyr_y();
-    imu_msg.imu.angular_velocity.z = imuData->gyr_z();
+    if (mask & IMU_MASK_ACC) {
+      imu_msg.imu.linear_acceleration.x = imuData->acc_x();
+      imu_msg.imu.linear_acceleration.y = imuData->acc_y();
+      imu_msg.imu.linear_acceleration.z = imuData->acc_z();
 
-    imu_msg.imu.compass.x = imuData->mag_x();
-    imu_msg.imu.compass.y = imuData->mag_y();
-    imu_msg.imu.compass.z = imuData->mag_z();
+      std_imu_msg.linear_acceleration.x = imuData->acc_x();
+      std_imu_msg.linear_acceleration.y = imuData->acc_y();
+      std_imu_msg.linear_acceleration.z = imuData->acc_z();
+    } else {
+      std_imu_msg.linear_acceleration_covariance[0] = -1.0;
+    }
 
-    imu_msg.imu.orientation.w = imuData->q_w();
-    imu_msg.imu.orientation.x = imuData->q_x();
-    imu_msg.imu.orientation.y = imuData->q_y();
-    imu_msg.imu.orientation.z = imuData->q_z();
+    if (mask & IMU_MASK_GYR) {
+      imu_msg.imu.angular_velocity.x = imuData->gyr_x();
+      imu_msg.imu.angular_velocity.y = imuData->gyr_y();
+      imu_msg.imu.angular_velocity.z = imuData->gyr_z();
 
-    std_imu_msg.linear_acceleration.x = imuData->acc_x();
-    std_imu_msg.linear_acceleration.y = imuData->acc_y();
-    std_imu_msg.linear_acceleration.z = imuData->acc_z();
+      std_imu_msg.angular_velocity.x = imuData->gyr_x();
+      std_imu_msg.angular_velocity.y = imuData->gyr_y();
+      std_imu_msg.angular_velocity.z = imuData->gyr_z();
+    } else {
+      std_imu_msg.angular_velocity_covariance[0] = -1.0;
+    }
 
-    std_imu_msg.angular_velocity.x = imuData->gyr_x();
-    std_imu_msg.angular_velocity.y = imuData->gyr_y();
-    std_imu_msg.angular_velocity.z = imuData->gyr_z();
+    if (mask & IMU_MASK_MAG) {
+      imu_msg.imu.compass.x = imuData->mag_x();
+      imu_msg.imu.compass.y = imuData->mag_y();
+      imu_msg.imu.compass.z = imuData->mag_z();
+    }
 
-    std_imu_msg.orientation.w = imuData->q_w();
-    std_imu_msg.orientation.x = imuData->q_x();
-    std_imu_msg.orientation.y = imuData->q_y();
-    std_imu_msg.orientation.z = imuData->q_z();
+    if (mask & IMU_MASK_QUAT) {
+      imu_msg.imu.orientation.w = imuData->q_w();
+      imu_msg.imu.orientation.x = imuData->q_x();
+      imu_msg.imu.orientation.y = imuData->q_y();
+      imu_msg.imu.orientation.z = imuData->q_z();
 
+      std_imu_msg.orientation.w = imuData->q_w();
+      std_imu_msg.orientation.x = imuData->q_x();
+      std_imu_msg.orientation.y = imuData->q_y();
+      std_imu_msg.orientation.z = imuData->q_z();
+    } else {
+      std_imu_msg.orientation_covariance[0] = -1.0;
+    }
 
     imu_pub_->publish(imu_msg);
+    VESC_TRACEPOINT(packet_published, packet->sequence(), "sensors/imu");
     imu_std_pub_->publish(std_imu_msg);
+    VESC_TRACEPOINT(packet_published, packet->sequence(), "sensors/imu/raw");
+    imu_frequency_->tick();
   }
   auto & clk = *this->get_clock();
   RCLCPP_DEBUG_THROTTLE(
@@ -258,9 +774,583 @@ void VescDriver::vescPacketCallback(const std::shared_ptr<VescPacket const> & pa
   );
 }
 
-void VescDriver::vescErrorCallback(const std::string & error)
+rclcpp::Time VescDriver::packetStamp(const VescPacket & packet)
+{
+  if (packet.rxStamp() == 0) {
+    return now();
+  }
+  // carry the age of the packet on the monotonic clock over to the ROS clock
+  const int64_t stamp_ns = stamp_sample_time_ ? vesc_.sampleStamp(packet) : packet.rxStamp();
+  const int64_t age_ns = monotonicNanoseconds() - stamp_ns;
+  return now() - rclcpp::Duration::from_nanoseconds(age_ns);
+}
+
+rcl_interfaces::msg::SetParametersResult VescDriver::parametersCallback(
+  const std::vector<rclcpp::Parameter> & parameters)
+{
+  rcl_interfaces::msg::SetParametersResult result;
+  for (CommandLimit * limit : {&duty_cycle_limit_, &current_limit_, &brake_limit_, &speed_limit_,
+      &position_limit_, &servo_limit_})
+  {
+    result.reason = limit->validate(parameters);
+    if (!result.reason.empty()) {
+      result.successful = false;
+      return result;
+    }
+  }
+  result.successful = true;
+#if !RCLCPP_VERSION_GTE(21, 0, 0)
+  // no post-set callbacks before Iron; this is the node's only on-set callback, so once it accepts
+  // the change nothing else can reject it
+  parametersSetCallback(parameters);
+#endif
+  return result;
+}
+
+void VescDriver::parametersSetCallback(const std::vector<rclcpp::Parameter> & parameters)
+{
+  duty_cycle_limit_.update(parameters);
+  current_limit_.update(parameters);
+  brake_limit_.update(parameters);
+  speed_limit_.update(parameters);
+  position_limit_.update(parameters);
+  servo_limit_.update(parameters);
+}
+
+void VescDriver::keepaliveCallback()
+{
+  if (driver_mode_ == MODE_OPERATING && command_watchdog_.keepaliveDue(monotonicNanoseconds())) {
+    trySend([this]() {vesc_.sendAlive();});
+  }
+}
+
+void VescDriver::handshakeCallback()
+{
+  if (driver_mode_ != MODE_INITIALIZING) {
+    handshake_timer_->cancel();
+    return;
+  }
+  // request version number, the reply completes the handshake
+  trySend([this]() {vesc_.requestFWVersion();});
+}
+
+bool VescDriver::isCachedIdentity(const VescIdentity & identity) const
+{
+  return have_cached_identity_ && identity.uuid == cached_identity_.uuid &&
+         identity.hwname == cached_identity_.hwname &&
+         identity.fw_major == cached_identity_.fw_major &&
+         identity.fw_minor == cached_identity_.fw_minor;
+}
+
+void VescDriver::updateIdentityCache(const VescIdentity & identity)
+{
+  if (isCachedIdentity(identity)) {
+    return;
+  }
+  if (have_cached_identity_) {
+    RCLCPP_WARN(
+      get_logger(), "Identity cache entry for %s was stale, now VESC %s with firmware %d.%d.",
+      port_.c_str(), identity.uuidString().c_str(), identity.fw_major, identity.fw_minor);
+  }
+  identity_cache_->store(usb_serial_, port_, identity);
+  cached_identity_ = identity;
+  have_cached_identity_ = true;
+}
+
+void VescDriver::loadMcConf()
 {
-  RCLCPP_ERROR(get_logger(), "%s", error.c_str());
+  const std::string uuid = vesc_identity_.uuidString();
+  {
+    std::lock_guard<std::mutex> lock(mcconf_mutex_);
+    if (mcconf_uuid_ == uuid && mcconf_fw_major_ == vesc_identity_.fw_major &&
+      mcconf_fw_minor_ == vesc_identity_.fw_minor)
+    {
+      return;
+    }
+  }
+
+  const VescConfCodec<mc_configuration> * codec =
+    mcConfCodec(vesc_identity_.fw_major, vesc_identity_.fw_minor);
+  if (codec == NULL) {
+    RCLCPP_WARN(
+      get_logger(), "Cannot decode the motor configuration of firmware %d.%d, not reading it.",
+      vesc_identity_.fw_major, vesc_identity_.fw_minor);
+    std::lock_guard<std::mutex> lock(mcconf_mutex_);
+    mcconf_uuid_ = uuid;
+    mcconf_fw_major_ = vesc_identity_.fw_major;
+    mcconf_fw_minor_ = vesc_identity_.fw_minor;
+    return;
+  }
+
+  // a copy with the signature this firmware sends is as good as a transfer, one with any other
+  // signature is fetched again
+  VescConfBlob blob;
+  mc_configuration conf;
+  if (conf_cache_ && !refresh_mcconf_ && conf_cache_->load(uuid, "mcconf", &blob) &&
+    blob.fw_major == vesc_identity_.fw_major && blob.fw_minor == vesc_identity_.fw_minor &&
+    codec->decode(blob.signature, blob.data.data(), blob.data.size(), &conf))
+  {
+    setMcConf(conf, true);
+    return;
+  }
+
+  mcconf_wanted_ = true;
+}
+
+void VescDriver::mcConfReceived(const VescPacketMcConf & packet)
+{
+  const VescConfCodec<mc_configuration> * codec =
+    mcConfCodec(vesc_identity_.fw_major, vesc_identity_.fw_minor);
+  BufferRangeConst data = packet.data();
+  VescConfBlob blob;
+  blob.fw_major = vesc_identity_.fw_major;
+  blob.fw_minor = vesc_identity_.fw_minor;
+  blob.signature = packet.signature();
+  blob.data.assign(data.first, data.second);
+
+  mc_configuration conf;
+  if (codec == NULL ||
+    !codec->decode(blob.signature, blob.data.data(), blob.data.size(), &conf))
+  {
+    RCLCPP_ERROR(
+      get_logger(), "The motor configuration (%zu bytes, signature %u) does not have the layout "
+      "of firmware %d.%d (%zu bytes, signature %u), ignoring it.", blob.data.size(),
+      blob.signature, blob.fw_major, blob.fw_minor, codec == NULL ? 0 : codec->size(),
+      codec == NULL ? 0u : codec->signature());
+    mcconf_wanted_ = false;
+    return;
+  }
+  mcconf_wanted_ = false;
+
+  if (conf_cache_) {
+    try {
+      conf_cache_->store(vesc_identity_.uuidString(), "mcconf", blob);
+    } catch (const std::runtime_error & e) {
+      RCLCPP_WARN(get_logger(), "Failed to keep the motor configuration, %s.", e.what());
+    }
+  }
+  setMcConf(conf, false);
+}
+
+void VescDriver::setMcConf(const mc_configuration & conf, bool from_disk)
+{
+  RCLCPP_INFO(
+    get_logger(), "Motor configuration %s: %d poles, current %.1f to %.1f A, %.0f to %.0f ERPM.",
+    from_disk ? "loaded from disk" : "read from the VESC", conf.si_motor_poles,
+    conf.l_current_min, conf.l_current_max, conf.l_min_erpm, conf.l_max_erpm);
+  {
+    std::lock_guard<std::mutex> lock(mcconf_mutex_);
+    mcconf_ = conf;
+    mcconf_uuid_ = vesc_identity_.uuidString();
+    mcconf_fw_major_ = vesc_identity_.fw_major;
+    mcconf_fw_minor_ = vesc_identity_.fw_minor;
+  }
+  mcconf_from_disk_ = from_disk;
+  mcconf_changed_ = true;
+}
+
+void VescDriver::applyMcConf()
+{
+  mc_configuration conf;
+  {
+    std::lock_guard<std::mutex> lock(mcconf_mutex_);
+    conf = mcconf_;
+  }
+
+  if (use_mcconf_limits_) {
+    // l_current_min and l_min_erpm are negative; the brake command is a positive current, up to
+    // the regenerative limit
+    duty_cycle_limit_.setDeviceRange(-conf.l_max_duty, conf.l_max_duty);
+    current_limit_.setDeviceRange(conf.l_current_min, conf.l_current_max);
+    brake_limit_.setDeviceRange(0.0, -conf.l_current_min);
+    speed_limit_.setDeviceRange(conf.l_min_erpm, conf.l_max_erpm);
+  }
+
+  // speed_to_erpm_gain is not derived from the si_* fields: vesc_ackermann converts commands and
+  // odometry with its own copy of the parameter, which the driver changing alone would contradict
+}
+
+void VescDriver::handshakeComplete()
+{
+  std::array<PendingCommand, NUM_COMMAND_SLOTS> pending;
+  {
+    std::lock_guard<std::mutex> lock(pending_commands_mutex_);
+    driver_mode_ = MODE_OPERATING;
+    pending.swap(pending_commands_);
+  }
+  RCLCPP_INFO(
+    get_logger(), "Connected to VESC with firmware version %d.%d",
+    fw_version_major_.load(), fw_version_minor_.load());
+  if (reconnect_pending_) {
+    reconnect_pending_ = false;
+    const auto latency = std::chrono::steady_clock::now() - link_lost_time_;
+    last_reconnect_latency_ns_ =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+    ++num_reconnects_;
+    RCLCPP_INFO(
+      get_logger(), "Reconnected %.1f ms after the link failed.",
+      std::chrono::duration<double, std::milli>(latency).count());
+  }
+
+  // send the kept commands in the order they arrived, in one write; unlike the topics they may
+  // have waited a while, so the command deadline applies to them
+  std::sort(
+    pending.begin(), pending.end(),
+    [](const PendingCommand & a, const PendingCommand & b) {return a.stamp_ns < b.stamp_ns;});
+  const int64_t now_ns = monotonicNanoseconds();
+  VescInterface::TxBatch batch(vesc_);
+  for (const auto & command : pending) {
+    if (!command.send) {
+      continue;
+    }
+    if (command_watchdog_.enabled() &&
+      (now_ns - command.stamp_ns) * 1e-9 > command_watchdog_.timeout())
+    {
+      ++num_stale_commands_;
+      continue;
+    }
+    if (command.slot == COMMAND_MOTOR) {
+      command_watchdog_.commandReceived(command.stamp_ns);
+    }
+    trySend(command.send);
+  }
+}
+
+void VescDriver::discardPendingCommands()
+{
+  std::lock_guard<std::mutex> lock(pending_commands_mutex_);
+  for (auto & command : pending_commands_) {
+    command.send = nullptr;
+  }
+}
+
+template<typename SendFunction>
+void VescDriver::dispatchCommand(command_slot_t slot, SendFunction && send)
+{
+  if (driver_mode_ != MODE_OPERATING) {
+    if (!buffer_commands_ && !confirm_cached_identity_) {
+      return;
+    }
+    // handshakeComplete() leaves INITIALIZING holding the lock, so a command is either kept here
+    // and sent by it, or sent below
+    std::lock_guard<std::mutex> lock(pending_commands_mutex_);
+    if (driver_mode_ == MODE_INITIALIZING) {
+      pending_commands_[slot] = PendingCommand{slot, monotonicNanoseconds(), send};
+      return;
+    } else if (driver_mode_ != MODE_OPERATING) {
+      return;
+    }
+  }
+  if (slot == COMMAND_MOTOR) {
+    motorCommandReceived();
+  }
+  trySend(send);
+}
+
+void VescDriver::linkLost()
+{
+  // stop sending commands before the port goes away
+  driver_mode_ = MODE_RECONNECTING;
+  confirm_cached_identity_ = false;
+  discardPendingCommands();
+  vesc_.disconnect();
+  if (!uuid_.empty() && reconnect_) {
+    // the VESC may come back on another port
+    searchDevice();
+  }
+  if (!reconnect_) {
+    RCLCPP_ERROR(
+      get_logger(), "Lost the connection to the VESC on %s, returning to unconfigured.",
+      port_.c_str());
+    deactivate();
+    cleanup();
+    return;
+  }
+
+  // a failed handshake after a reconnect keeps the original loss time, so the latency covers the
+  // whole outage
+  if (!reconnect_pending_) {
+    RCLCPP_ERROR(
+      get_logger(), "Lost the connection to the VESC on %s, reconnecting.", port_.c_str());
+    link_lost_time_ = std::chrono::steady_clock::now();
+    reconnect_delay_ = reconnect_initial_delay_;
+    reconnect_pending_ = true;
+  }
+  driver_mode_ = MODE_RECONNECTING;
+  next_reconnect_time_ = std::chrono::steady_clock::now() +
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(reconnect_delay_));
+  reconnect_delay_ = std::min(2.0 * reconnect_delay_, reconnect_max_delay_);
+}
+
+void VescDriver::reconnect()
+{
+  if (std::chrono::steady_clock::now() < next_reconnect_time_) {
+    return;
+  }
+
+  if (!uuid_.empty()) {
+    // wait for the device monitor to find the VESC, it need not be where it was
+    std::lock_guard<std::mutex> lock(found_port_mutex_);
+    if (found_port_.empty()) {
+      return;
+    }
+    port_.swap(found_port_);
+    found_port_.clear();
+    if (identity_cache_) {
+      usb_serial_ = usbSerialNumber(port_);
+      have_cached_identity_ = identity_cache_->find(usb_serial_, port_, &cached_identity_);
+    }
+  }
+
+  try {
+    vesc_.connect(port_);
+  } catch (const SerialException & e) {
+    RCLCPP_DEBUG(get_logger(), "Reconnect failed, %s.", e.what());
+    if (!uuid_.empty()) {
+      searchDevice();
+    }
+    next_reconnect_time_ = std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(reconnect_delay_));
+    reconnect_delay_ = std::min(2.0 * reconnect_delay_, reconnect_max_delay_);
+    return;
+  }
+
+  // the publishers and subscriptions stay up, only the handshake is repeated; commands from before
+  // the outage no longer count towards the command deadline
+  fw_version_major_ = -1;
+  fw_version_minor_ = -1;
+  command_watchdog_.reset();
+  command_timed_out_ = false;
+  driver_mode_ = MODE_INITIALIZING;
+  trySend([this]() {vesc_.requestFWVersion();});
+  handshake_timer_->reset();
+}
+
+void VescDriver::searchDevice()
+{
+  {
+    std::lock_guard<std::mutex> lock(found_port_mutex_);
+    found_port_.clear();
+  }
+  searching_ = true;
+  device_monitor_->rescan();
+}
+
+void VescDriver::deviceAdded(const std::string & port)
+{
+  if (!searching_) {
+    return;
+  }
+
+  // a cached answer is re-validated while the lookup lives, on this port's own monitor thread
+  const auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::duration<double>(uuid_lookup_timeout_));
+  VescDeviceLookup lookup(port, identity_cache_, timeout);
+  if (!lookup.waitReady(timeout)) {
+    RCLCPP_DEBUG(get_logger(), "No VESC answered on %s.", port.c_str());
+    return;
+  }
+  const std::string uuid = lookup.deviceUUID();
+  if (uuid != uuid_) {
+    RCLCPP_DEBUG(get_logger(), "VESC %s on %s is not the one wanted.", uuid.c_str(), port.c_str());
+    return;
+  }
+  // the driver opens the port next and confirms a cached identity with its own handshake
+  lookup.close();
+
+  {
+    std::lock_guard<std::mutex> lock(found_port_mutex_);
+    if (!searching_) {
+      return;
+    }
+    found_port_ = port;
+    searching_ = false;
+  }
+  found_port_condition_.notify_all();
+}
+
+void VescDriver::motorCommandReceived()
+{
+  command_watchdog_.commandReceived(monotonicNanoseconds());
+}
+
+void VescDriver::checkCommandDeadline()
+{
+  const int64_t now_ns = monotonicNanoseconds();
+  const double age = command_watchdog_.age(now_ns);
+  if (age < 0.0) {
+    return;
+  }
+
+  if (!command_watchdog_.expired(now_ns)) {
+    if (command_timed_out_) {
+      RCLCPP_INFO(get_logger(), "Motor commands resumed.");
+      command_timed_out_ = false;
+    }
+    return;
+  }
+
+  if (!command_timed_out_) {
+    RCLCPP_WARN(
+      get_logger(), "No motor command for %.3f s, stopping the motor.", age);
+    command_timed_out_ = true;
+    ++num_command_timeouts_;
+  }
+  // repeat the safe command every cycle, a single lost frame must not leave the motor running
+  if (timeout_brake_current_ > 0.0) {
+    vesc_.setBrake(brake_limit_.clip(timeout_brake_current_));
+  } else {
+    vesc_.setCurrent(0.0);
+  }
+}
+
+bool VescDriver::commandIsStale(const rclcpp::Time & stamp)
+{
+  // unstamped commands are never stale
+  if (!command_watchdog_.enabled() || stamp.nanoseconds() == 0) {
+    return false;
+  }
+  const double age = (now() - stamp).seconds();
+  if (age <= command_watchdog_.timeout()) {
+    return false;
+  }
+  ++num_stale_commands_;
+  auto & clk = *get_clock();
+  RCLCPP_WARN_THROTTLE(get_logger(), clk, 1000, "Dropping command stamped %.3f s ago.", age);
+  return true;
+}
+
+void VescDriver::errorReportCallback()
+{
+  VescErrorCounts counts = vesc_.errorCounts();
+  VescErrorCounts delta = counts - last_error_counts_;
+  last_error_counts_ = counts;
+  if (delta.total() > 0) {
+    RCLCPP_ERROR(
+      get_logger(), "Discarded data from VESC: %s.", delta.toString().c_str());
+  }
+  reportRecordingError();
+}
+
+void VescDriver::reportRecordingError()
+{
+  std::string error = vesc_.takeRecordingError();
+  if (!error.empty()) {
+    RCLCPP_ERROR(get_logger(), "Stopped recording the serial stream, %s.", error.c_str());
+  }
+}
+
+void VescDriver::linkDiagnostics(diagnostic_updater::DiagnosticStatusWrapper & status)
+{
+  using diagnostic_msgs::msg::DiagnosticStatus;
+
+  auto now = std::chrono::steady_clock::now();
+  double elapsed = std::chrono::duration<double>(now - last_diagnostic_time_).count();
+  VescErrorCounts counts = vesc_.errorCounts();
+  VescErrorCounts delta = counts - last_diagnostic_error_counts_;
+  last_diagnostic_error_counts_ = counts;
+  last_diagnostic_time_ = now;
+
+  double checksum_rate = delta.events[VESC_ERROR_INVALID_CHECKSUM] / elapsed;
+  double resync_rate = delta.events[VESC_ERROR_OUT_OF_SYNC] / elapsed;
+  double discarded_rate = delta.bytes[VESC_ERROR_OUT_OF_SYNC] / elapsed;
+
+  VescLinkStats::Summary link = vesc_.linkStats();
+  status.add("RTT samples", link.num_samples);
+  status.addf("RTT p50 (ms)", "%.2f", link.rtt_p50 * 1e3);
+  status.addf("RTT p95 (ms)", "%.2f", link.rtt_p95 * 1e3);
+  status.addf("RTT p99 (ms)", "%.2f", link.rtt_p99 * 1e3);
+  status.addf("RTT max (ms)", "%.2f", link.rtt_max * 1e3);
+  status.add("Lost requests", link.num_lost);
+  VescDelayEstimator::Estimate delay = vesc_.delayEstimate();
+  status.addf("Reply delay (ms)", "%.3f", delay.delay * 1e3);
+  status.addf("Reply delay uncertainty (ms)", "%.3f", delay.uncertainty * 1e3);
+  status.addf("Reply delay jitter (ms)", "%.3f", delay.jitter * 1e3);
+  status.addf("Checksum errors per second", "%.2f", checksum_rate);
+  status.addf("Resyncs per second", "%.2f", resync_rate);
+  status.addf("Discarded bytes per second", "%.1f", discarded_rate);
+  status.add("Reconnects", num_reconnects_.load());
+  const int64_t reconnect_latency_ns = last_reconnect_latency_ns_;
+  if (reconnect_latency_ns >= 0) {
+    status.addf("Last reconnect latency (ms)", "%.1f", reconnect_latency_ns * 1e-6);
+  } else {
+    status.add("Last reconnect latency (ms)", "none");
+  }
+
+  if (!vesc_.isConnected()) {
+    status.summary(DiagnosticStatus::ERROR, "Disconnected from serial port");
+    return;
+  }
+  if (link.last_packet_ns < 0) {
+    status.add("Time since last packet (s)", "never");
+    status.summary(DiagnosticStatus::ERROR, "No packets received");
+    return;
+  }
+
+  double age = (monotonicNanoseconds() - link.last_packet_ns) * 1e-9;
+  status.addf("Time since last packet (s)", "%.3f", age);
+  // the VESC is polled every 20 ms
+  if (age > 1.0) {
+    status.summary(DiagnosticStatus::ERROR, "No packets received recently");
+  } else if (age > 0.1 || checksum_rate > 0.0 || resync_rate > 0.0) {
+    status.summary(DiagnosticStatus::WARN, "Link degraded");
+  } else {
+    status.summary(DiagnosticStatus::OK, "Link OK");
+  }
+}
+
+void VescDriver::controllerDiagnostics(diagnostic_updater::DiagnosticStatusWrapper & status)
+{
+  using diagnostic_msgs::msg::DiagnosticStatus;
+
+  const int fw_major = fw_version_major_;
+  const int fw_minor = fw_version_minor_;
+  if (fw_major >= 0 && fw_minor >= 0) {
+    status.addf("Firmware version", "%d.%d", fw_major, fw_minor);
+  } else {
+    status.add("Firmware version", "unknown");
+  }
+
+  if (!read_mcconf_) {
+    status.add("Motor configuration", "not read");
+  } else {
+    std::lock_guard<std::mutex> lock(mcconf_mutex_);
+    if (mcconf_fw_major_ < 0 || mcconf_wanted_) {
+      status.add("Motor configuration", "pending");
+    } else if (mcConfCodec(mcconf_fw_major_, mcconf_fw_minor_) == NULL) {
+      status.add("Motor configuration", "unsupported firmware");
+    } else {
+      status.add("Motor configuration", mcconf_from_disk_ ? "loaded from disk" : "read");
+      status.add("Motor poles", static_cast<int>(mcconf_.si_motor_poles));
+    }
+  }
+
+  status.add("Motor command timed out", command_timed_out_ ? "yes" : "no");
+  status.add("Motor command timeouts", num_command_timeouts_.load());
+  status.add("Stale commands dropped", num_stale_commands_.load());
+
+  int fault_code = fault_code_;
+  status.add("Fault code", fault_code);
+  switch (fault_code) {
+    case -1:
+      status.summary(DiagnosticStatus::WARN, "No telemetry received");
+      break;
+    case FAULT_CODE_NONE:
+      status.summary(DiagnosticStatus::OK, "No fault");
+      break;
+    // conditions the controller recovers from by itself, e.g. by limiting current
+    case FAULT_CODE_UNDER_VOLTAGE:
+    case FAULT_CODE_OVER_TEMP_FET:
+    case FAULT_CODE_OVER_TEMP_MOTOR:
+    case FAULT_CODE_BOOTING_FROM_WATCHDOG_RESET:
+      status.summaryf(DiagnosticStatus::WARN, "Fault code %d", fault_code);
+      break;
+    default:
+      status.summaryf(DiagnosticStatus::ERROR, "Fault code %d", fault_code);
+      break;
+  }
 }
 
 /**
@@ -270,9 +1360,9 @@ void VescDriver::vescErrorCallback(const std::string & error)
  */
 void VescDriver::dutyCycleCallback(const Float64::SharedPtr duty_cycle)
 {
-  if (driver_mode_ == MODE_OPERATING) {
-    vesc_.setDutyCycle(duty_cycle_limit_.clip(duty_cycle->data));
-  }
+  VESC_TRACEPOINT(command_received, "commands/motor/duty_cycle", duty_cycle->data);
+  const double value = duty_cycle_limit_.clip(duty_cycle->data);
+  dispatchCommand(COMMAND_MOTOR, [this, value]() {vesc_.setDutyCycle(value);});
 }
 
 /**
@@ -282,9 +1372,9 @@ void VescDriver::dutyCycleCallback(const Float64::SharedPtr duty_cycle)
  */
 void VescDriver::currentCallback(const Float64::SharedPtr current)
 {
-  if (driver_mode_ == MODE_OPERATING) {
-    vesc_.setCurrent(current_limit_.clip(current->data));
-  }
+  VESC_TRACEPOINT(command_received, "commands/motor/current", current->data);
+  const double value = current_limit_.clip(current->data);
+  dispatchCommand(COMMAND_MOTOR, [this, value]() {vesc_.setCurrent(value);});
 }
 
 /**
@@ -294,9 +1384,9 @@ void VescDriver::currentCallback(const Float64::SharedPtr current)
  */
 void VescDriver::brakeCallback(const Float64::SharedPtr brake)
 {
-  if (driver_mode_ == MODE_OPERATING) {
-    vesc_.setBrake(brake_limit_.clip(brake->data));
-  }
+  VESC_TRACEPOINT(command_received, "commands/motor/brake", brake->data);
+  const double value = brake_limit_.clip(brake->data);
+  dispatchCommand(COMMAND_MOTOR, [this, value]() {vesc_.setBrake(value);});
 }
 
 /**
@@ -307,9 +1397,9 @@ void VescDriver::brakeCallback(const Float64::SharedPtr brake)
  */
 void VescDriver::speedCallback(const Float64::SharedPtr speed)
 {
-  if (driver_mode_ == MODE_OPERATING) {
-    vesc_.setSpeed(speed_limit_.clip(speed->data));
-  }
+  VESC_TRACEPOINT(command_received, "commands/motor/speed", speed->data);
+  const double value = speed_limit_.clip(speed->data);
+  dispatchCommand(COMMAND_MOTOR, [this, value]() {vesc_.setSpeed(value);});
 }
 
 /**
@@ -318,11 +1408,10 @@ void VescDriver::speedCallback(const Float64::SharedPtr speed)
  */
 void VescDriver::positionCallback(const Float64::SharedPtr position)
 {
-  if (driver_mode_ == MODE_OPERATING) {
-    // ROS uses radians but VESC seems to use degrees. Convert to degrees.
-    double position_deg = position_limit_.clip(position->data) * 180.0 / M_PI;
-    vesc_.setPosition(position_deg);
-  }
+  VESC_TRACEPOINT(command_received, "commands/motor/position", position->data);
+  // ROS uses radians but VESC seems to use degrees. Convert to degrees.
+  const double position_deg = position_limit_.clip(position->data) * 180.0 / M_PI;
+  dispatchCommand(COMMAND_MOTOR, [this, position_deg]() {vesc_.setPosition(position_deg);});
 }
 
 /**
@@ -330,112 +1419,238 @@ void VescDriver::positionCallback(const Float64::SharedPtr position)
  */
 void VescDriver::servoCallback(const Float64::SharedPtr servo)
 {
-  if (driver_mode_ == MODE_OPERATING) {
-    double servo_clipped(servo_limit_.clip(servo->data));
-    vesc_.setServo(servo_clipped);
-    // publish clipped servo value as a "sensor"
-    auto servo_sensor_msg = Float64();
-    servo_sensor_msg.data = servo_clipped;
-    servo_sensor_pub_->publish(servo_sensor_msg);
+  VESC_TRACEPOINT(command_received, "commands/servo/position", servo->data);
+  const double servo_clipped(servo_limit_.clip(servo->data));
+  dispatchCommand(
+    COMMAND_SERVO, [this, servo_clipped]() {
+      vesc_.setServo(servo_clipped);
+      // publish clipped servo value as a "sensor"
+      auto servo_sensor_msg = Float64();
+      servo_sensor_msg.data = servo_clipped;
+      servo_sensor_pub_->publish(servo_sensor_msg);
+    });
+}
+
+/**
+ * @param cmd Commanded speed in meters per second and steering angle in radians. Converted to
+ *            electrical RPM and servo position with the speed_to_erpm and steering_angle_to_servo
+ *            gains and offsets, then clipped to the speed and servo limits.
+ */
+void VescDriver::ackermannCmdCallback(const AckermannDriveStamped::SharedPtr cmd)
+{
+  double erpm = speed_to_erpm_gain_ * cmd->drive.speed + speed_to_erpm_offset_;
+  double servo = steering_to_servo_gain_ * cmd->drive.steering_angle + steering_to_servo_offset_;
+  VESC_TRACEPOINT(command_received, "ackermann_cmd", erpm);
+  if (commandIsStale(cmd->header.stamp)) {
+    return;
   }
+  const double erpm_clipped(speed_limit_.clip(erpm));
+  const double servo_clipped(servo_limit_.clip(servo));
+  dispatchCommand(
+    COMMAND_MOTOR, [this, erpm_clipped, servo_clipped]() {
+      {
+        // both frames leave in one write, so the VESC applies speed and steering together
+        VescInterface::TxBatch batch(vesc_);
+        vesc_.setSpeed(erpm_clipped);
+        vesc_.setServo(servo_clipped);
+      }
+      // publish clipped servo value as a "sensor"
+      auto servo_sensor_msg = Float64();
+      servo_sensor_msg.data = servo_clipped;
+      servo_sensor_pub_->publish(servo_sensor_msg);
+    });
 }
 
 VescDriver::CommandLimit::CommandLimit(
-  rclcpp::Node * node_ptr,
+  rclcpp_lifecycle::LifecycleNode * node_ptr,
   const std::string & str,
   const std::experimental::optional<double> & min_lower,
   const std::experimental::optional<double> & max_upper)
 : node_ptr(node_ptr),
   logger(node_ptr->get_logger()),
-  name(str)
+  clock(node_ptr->get_clock()),
+  name(str),
+  min_lower(min_lower),
+  max_upper(max_upper),
+  bounds_(nullptr),
+  readers_(0),
+  param_min_(0.0),
+  param_max_(0.0)
 {
-  // check if user's minimum value is outside of the range min_lower to max_upper
-  auto param_min =
-    node_ptr->declare_parameter(name + "_min", rclcpp::ParameterValue(0.0));
-
-  if (param_min.get_type() != rclcpp::ParameterType::PARAMETER_NOT_SET) {
-    if (min_lower && param_min.get<double>() < *min_lower) {
-      lower = *min_lower;
-      RCLCPP_WARN_STREAM(
-        logger, "Parameter " << name << "_min (" << param_min.get<double>() <<
-          ") is less than the feasible minimum (" << *min_lower << ").");
-    } else if (max_upper && param_min.get<double>() > *max_upper) {
-      lower = *max_upper;
-      RCLCPP_WARN_STREAM(
-        logger, "Parameter " << name << "_min (" << param_min.get<double>() <<
-          ") is greater than the feasible maximum (" << *max_upper << ").");
-    } else {
-      lower = param_min.get<double>();
-    }
-  } else if (min_lower) {
-    lower = *min_lower;
+  // limits are often written as integers, e.g. speed_max: 10
+  rcl_interfaces::msg::ParameterDescriptor descriptor;
+  descriptor.dynamic_typing = true;
+  double param_min(0.0), param_max(0.0);
+  if (!parameterAsDouble(
+      node_ptr->declare_parameter(name + "_min", rclcpp::ParameterValue(0.0), descriptor),
+      &param_min))
+  {
+    RCLCPP_ERROR(logger, "Parameter %s_min is not a number, using 0.", name.c_str());
+  }
+  if (!parameterAsDouble(
+      node_ptr->declare_parameter(name + "_max", rclcpp::ParameterValue(0.0), descriptor),
+      &param_max))
+  {
+    RCLCPP_ERROR(logger, "Parameter %s_max is not a number, using 0.", name.c_str());
   }
 
-  // check if the uers' maximum value is outside of the range min_lower to max_upper
-  auto param_max =
-    node_ptr->declare_parameter(name + "_max", rclcpp::ParameterValue(0.0));
-
-  if (param_max.get_type() != rclcpp::ParameterType::PARAMETER_NOT_SET) {
-    if (min_lower && param_max.get<double>() < *min_lower) {
-      upper = *min_lower;
-      RCLCPP_WARN_STREAM(
-        logger, "Parameter " << name << "_max (" << param_max.get<double>() <<
-          ") is less than the feasible minimum (" << *min_lower << ").");
-    } else if (max_upper && param_max.get<double>() > *max_upper) {
-      upper = *max_upper;
-      RCLCPP_WARN_STREAM(
-        logger, "Parameter " << name << "_max (" << param_max.get<double>() <<
-          ") is greater than the feasible maximum (" << *max_upper << ").");
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  setBounds(param_min, param_max);
+}
+
+std::string VescDriver::CommandLimit::validate(const std::vector<rclcpp::Parameter> & parameters)
+{
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  double param_min(param_min_);
+  double param_max(param_max_);
+  bool changed(false);
+  for (const auto & parameter : parameters) {
+    double * value;
+    if (parameter.get_name() == name + "_min") {
+      value = &param_min;
+    } else if (parameter.get_name() == name + "_max") {
+      value = &param_max;
     } else {
-      upper = param_max.get<double>();
+      continue;
+    }
+    std::ostringstream reason;
+    if (!parameterAsDouble(parameter.get_parameter_value(), value) || !std::isfinite(*value)) {
+      reason << parameter.get_name() << " must be a finite number.";
+      return reason.str();
     }
-  } else if (max_upper) {
-    upper = *max_upper;
+    if ((min_lower && *value < *min_lower) || (max_upper && *value > *max_upper)) {
+      reason << parameter.get_name() << " (" << *value << ") is outside the feasible range " <<
+        (min_lower ? *min_lower : -INFINITY) << " to " << (max_upper ? *max_upper : INFINITY) <<
+        ".";
+      return reason.str();
+    }
+    changed = true;
+  }
+  if (changed && param_min > param_max) {
+    std::ostringstream reason;
+    reason << name << "_min (" << param_min << ") is greater than " << name << "_max (" <<
+      param_max << ").";
+    return reason.str();
   }
+  return std::string();
+}
 
-  // check for min > max
-  if (upper && lower && *lower > *upper) {
-    RCLCPP_WARN_STREAM(
-      logger, "Parameter " << name << "_max (" << *upper <<
-        ") is less than parameter " << name << "_min (" << *lower << ").");
-    double temp(*lower);
-    lower = *upper;
-    upper = temp;
+void VescDriver::CommandLimit::update(const std::vector<rclcpp::Parameter> & parameters)
+{
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  double param_min(param_min_);
+  double param_max(param_max_);
+  bool changed(false);
+  for (const auto & parameter : parameters) {
+    if (parameter.get_name() == name + "_min") {
+      changed |= parameterAsDouble(parameter.get_parameter_value(), &param_min);
+    } else if (parameter.get_name() == name + "_max") {
+      changed |= parameterAsDouble(parameter.get_parameter_value(), &param_max);
+    }
+  }
+  if (changed) {
+    setBounds(param_min, param_max);
+    RCLCPP_INFO(logger, "Updated %s limits.", name.c_str());
   }
+}
 
-  std::ostringstream oss;
-  oss << "  " << name << " limit: ";
+void VescDriver::CommandLimit::setDeviceRange(double lower, double upper)
+{
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  device_lower_ = lower;
+  device_upper_ = upper;
+  setBounds(param_min_, param_max_);
+  RCLCPP_INFO(logger, "Limited %s to the VESC's range %g to %g.", name.c_str(), lower, upper);
+}
+
+void VescDriver::CommandLimit::setBounds(double param_min, double param_max)
+{
+  param_min_ = param_min;
+  param_max_ = param_max;
+  std::unique_ptr<Bounds> bounds(new Bounds);
 
-  if (lower) {
-    oss << *lower << " ";
+  // the feasible range, narrowed to the VESC's own limits if they are known
+  std::experimental::optional<double> min_lower(this->min_lower);
+  std::experimental::optional<double> max_upper(this->max_upper);
+  if (device_lower_ && (!min_lower || *device_lower_ > *min_lower)) {
+    min_lower = device_lower_;
+  }
+  if (device_upper_ && (!max_upper || *device_upper_ < *max_upper)) {
+    max_upper = device_upper_;
+  }
+
+  // check if user's minimum value is outside of the range min_lower to max_upper
+  if (min_lower && param_min < *min_lower) {
+    bounds->lower = *min_lower;
+    RCLCPP_WARN_STREAM(
+      logger, "Parameter " << name << "_min (" << param_min <<
+        ") is less than the feasible minimum (" << *min_lower << ").");
+  } else if (max_upper && param_min > *max_upper) {
+    bounds->lower = *max_upper;
+    RCLCPP_WARN_STREAM(
+      logger, "Parameter " << name << "_min (" << param_min <<
+        ") is greater than the feasible maximum (" << *max_upper << ").");
   } else {
-    oss << "(none) ";
+    bounds->lower = param_min;
   }
 
-  if (upper) {
-    oss << *upper;
+  // check if the uers' maximum value is outside of the range min_lower to max_upper
+  if (min_lower && param_max < *min_lower) {
+    bounds->upper = *min_lower;
+    RCLCPP_WARN_STREAM(
+      logger, "Parameter " << name << "_max (" << param_max <<
+        ") is less than the feasible minimum (" << *min_lower << ").");
+  } else if (max_upper && param_max > *max_upper) {
+    bounds->upper = *max_upper;
+    RCLCPP_WARN_STREAM(
+      logger, "Parameter " << name << "_max (" << param_max <<
+        ") is greater than the feasible maximum (" << *max_upper << ").");
   } else {
-    oss << "(none)";
+    bounds->upper = param_max;
+  }
+
+  // check for min > max
+  if (bounds->lower > bounds->upper) {
+    RCLCPP_WARN_STREAM(
+      logger, "Parameter " << name << "_max (" << bounds->upper <<
+        ") is less than parameter " << name << "_min (" << bounds->lower << ").");
+    std::swap(bounds->lower, bounds->upper);
   }
 
+  std::ostringstream oss;
+  oss << "  " << name << " limit: " << bounds->lower << " " << bounds->upper;
   RCLCPP_DEBUG_STREAM(logger, oss.str());
+
+  // clip() announces itself before loading the snapshot and retracts once it has copied it; with
+  // sequentially consistent operations on both sides, a clip() that is not counted here loads the
+  // new snapshot or has finished with the old ones
+  bounds_.store(bounds.get());
+  if (current_) {
+    retired_.emplace_back(std::move(current_));
+  }
+  current_ = std::move(bounds);
+  if (readers_.load() == 0) {
+    retired_.clear();
+  }
 }
 
 double VescDriver::CommandLimit::clip(double value)
 {
-  auto clock = rclcpp::Clock(RCL_ROS_TIME);
+  readers_.fetch_add(1);
+  const Bounds bounds = *bounds_.load();
+  readers_.fetch_sub(1);
 
-  if (lower && value < lower) {
+  if (value < bounds.lower) {
     RCLCPP_INFO_THROTTLE(
-      logger, clock, 10, "%s command value (%f) below minimum limit (%f), clipping.",
-      name.c_str(), value, *lower);
-    return *lower;
+      logger, *clock, 10, "%s command value (%f) below minimum limit (%f), clipping.",
+      name.c_str(), value, bounds.lower);
+    return bounds.lower;
   }
-  if (upper && value > upper) {
+  if (value > bounds.upper) {
     RCLCPP_INFO_THROTTLE(
-      logger, clock, 10, "%s command value (%f) above maximum limit (%f), clipping.",
-      name.c_str(), value, *upper);
-    return *upper;
+      logger, *clock, 10, "%s command value (%f) above maximum limit (%f), clipping.",
+      name.c_str(), value, bounds.upper);
+    return bounds.upper;
   }
   return value;
 }
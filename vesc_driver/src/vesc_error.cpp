@@ -0,0 +1,118 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_error.hpp"
+
+#include <sstream>
+#include <string>
+
+namespace vesc_driver
+{
+
+const char * vescErrorString(VescErrorCode code)
+{
+  switch (code) {
+    case VESC_ERROR_INCOMPLETE_FRAME:
+      return "incomplete frame";
+    case VESC_ERROR_NO_START_OF_FRAME:
+      return "missing start-of-frame";
+    case VESC_ERROR_INVALID_LENGTH:
+      return "invalid payload length";
+    case VESC_ERROR_INVALID_END_OF_FRAME:
+      return "invalid end-of-frame";
+    case VESC_ERROR_INVALID_CHECKSUM:
+      return "invalid checksum";
+    case VESC_ERROR_UNKNOWN_PAYLOAD:
+      return "unknown payload type";
+    case VESC_ERROR_EMPTY_PAYLOAD:
+      return "empty payload";
+    case VESC_ERROR_OUT_OF_SYNC:
+      return "out-of-sync";
+    default:
+      return "unknown error";
+  }
+}
+
+uint64_t VescErrorCounts::total() const
+{
+  uint64_t sum = 0;
+  for (int i = 0; i < VESC_ERROR_NUM_CODES; i++) {
+    sum += events[i];
+  }
+  return sum;
+}
+
+VescErrorCounts VescErrorCounts::operator-(const VescErrorCounts & earlier) const
+{
+  VescErrorCounts delta;
+  for (int i = 0; i < VESC_ERROR_NUM_CODES; i++) {
+    delta.events[i] = events[i] - earlier.events[i];
+    delta.bytes[i] = bytes[i] - earlier.bytes[i];
+  }
+  return delta;
+}
+
+std::string VescErrorCounts::toString() const
+{
+  std::ostringstream ss;
+  for (int i = 0; i < VESC_ERROR_NUM_CODES; i++) {
+    if (events[i] == 0) {
+      continue;
+    }
+    if (ss.tellp() > 0) {
+      ss << ", ";
+    }
+    ss << events[i] << " " << vescErrorString(static_cast<VescErrorCode>(i));
+    if (bytes[i] > 0) {
+      ss << " (" << bytes[i] << " bytes)";
+    }
+  }
+  return ss.str();
+}
+
+VescErrorCounters::VescErrorCounters()
+{
+  for (int i = 0; i < VESC_ERROR_NUM_CODES; i++) {
+    events_[i] = 0;
+    bytes_[i] = 0;
+  }
+}
+
+VescErrorCounts VescErrorCounters::snapshot() const
+{
+  VescErrorCounts counts;
+  for (int i = 0; i < VESC_ERROR_NUM_CODES; i++) {
+    counts.events[i] = events_[i].load(std::memory_order_relaxed);
+    counts.bytes[i] = bytes_[i].load(std::memory_order_relaxed);
+  }
+  return counts;
+}
+
+}  // namespace vesc_driver
@@ -0,0 +1,185 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_float_decode.hpp"
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__) && defined(VESC_DRIVER_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace vesc_driver
+{
+
+namespace
+{
+
+const uint32_t SIGN_MASK = 0x80000000u;
+const uint32_t EXPONENT_MASK = 0x7F800000u;
+const uint32_t FRACTION_MASK = 0x007FFFFFu;
+
+inline float fromBits(uint32_t bits)
+{
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+inline uint32_t toBits(float value)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+inline uint32_t loadBigEndian(const uint8_t * data)
+{
+  return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+         (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+/** Re-decodes the lanes flagged in @p special with the exact scalar decoder. */
+inline void patchSpecialLanes(float * out, unsigned int special)
+{
+  for (int lane = 0; special != 0; ++lane, special >>= 1) {
+    if (special & 1) {
+      out[lane] = decodeFloat32Auto(toBits(out[lane]));
+    }
+  }
+}
+
+}  // namespace
+
+float decodeFloat32Auto(uint32_t bits)
+{
+  const uint32_t exponent = bits & EXPONENT_MASK;
+  if (exponent == EXPONENT_MASK) {
+    // the firmware computes ldexpf(m, 129) with m in [0.5, 1), which always overflows
+    return fromBits((bits & SIGN_MASK) | EXPONENT_MASK);
+  }
+  if (exponent == 0 && (bits & FRACTION_MASK) != 0) {
+    // (2^23 + fraction) * 2^-150 rounded to the subnormal grid of 2^-149, ties to even; a carry
+    // out of the fraction correctly produces the smallest normal number
+    const uint32_t mantissa = (bits & FRACTION_MASK) | 0x00800000u;
+    uint32_t magnitude = mantissa >> 1;
+    if ((mantissa & 1) && (magnitude & 1)) {
+      ++magnitude;
+    }
+    return fromBits((bits & SIGN_MASK) | magnitude);
+  }
+  // normal numbers and zero share the IEEE-754 encoding
+  return fromBits(bits);
+}
+
+void decodeFloat32AutoBlock(const uint8_t * data, std::size_t count, float * out)
+{
+  std::size_t i = 0;
+
+#if defined(__AVX2__)
+  const __m256i swap = _mm256_setr_epi8(
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  const __m256i exponent_mask = _mm256_set1_epi32(static_cast<int>(EXPONENT_MASK));
+  const __m256i fraction_mask = _mm256_set1_epi32(static_cast<int>(FRACTION_MASK));
+  const __m256i zero = _mm256_setzero_si256();
+  for (; i + 8 <= count; i += 8) {
+    const __m256i bits = _mm256_shuffle_epi8(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 4 * i)), swap);
+    const __m256i exponent = _mm256_and_si256(bits, exponent_mask);
+    const __m256i subnormal = _mm256_andnot_si256(
+      _mm256_cmpeq_epi32(_mm256_and_si256(bits, fraction_mask), zero),
+      _mm256_cmpeq_epi32(exponent, zero));
+    const __m256i special = _mm256_or_si256(
+      subnormal, _mm256_cmpeq_epi32(exponent, exponent_mask));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), bits);
+    patchSpecialLanes(out + i, _mm256_movemask_ps(_mm256_castsi256_ps(special)));
+  }
+#elif defined(__SSE2__)
+#if defined(__SSSE3__)
+  const __m128i swap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+#else
+  const __m128i low_byte = _mm_set1_epi32(0x000000FF);
+#endif
+  const __m128i exponent_mask = _mm_set1_epi32(static_cast<int>(EXPONENT_MASK));
+  const __m128i fraction_mask = _mm_set1_epi32(static_cast<int>(FRACTION_MASK));
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 4 <= count; i += 4) {
+    const __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 4 * i));
+#if defined(__SSSE3__)
+    const __m128i bits = _mm_shuffle_epi8(raw, swap);
+#else
+    // swap bytes 0<->3 with shifts, then bytes 1<->2 within the middle 16 bits
+    const __m128i outer = _mm_or_si128(_mm_slli_epi32(raw, 24), _mm_srli_epi32(raw, 24));
+    const __m128i inner = _mm_or_si128(
+      _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(raw, 16), low_byte), 8),
+      _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(raw, 8), low_byte), 16));
+    const __m128i bits = _mm_or_si128(outer, inner);
+#endif
+    const __m128i exponent = _mm_and_si128(bits, exponent_mask);
+    const __m128i subnormal = _mm_andnot_si128(
+      _mm_cmpeq_epi32(_mm_and_si128(bits, fraction_mask), zero),
+      _mm_cmpeq_epi32(exponent, zero));
+    const __m128i special = _mm_or_si128(subnormal, _mm_cmpeq_epi32(exponent, exponent_mask));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), bits);
+    patchSpecialLanes(out + i, _mm_movemask_ps(_mm_castsi128_ps(special)));
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__) && defined(VESC_DRIVER_NEON)
+  const uint32x4_t exponent_mask = vdupq_n_u32(EXPONENT_MASK);
+  const uint32x4_t fraction_mask = vdupq_n_u32(FRACTION_MASK);
+  const uint32x4_t zero = vdupq_n_u32(0);
+  for (; i + 4 <= count; i += 4) {
+    const uint32x4_t bits = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 4 * i)));
+    const uint32x4_t exponent = vandq_u32(bits, exponent_mask);
+    const uint32x4_t subnormal = vbicq_u32(
+      vceqq_u32(exponent, zero), vceqq_u32(vandq_u32(bits, fraction_mask), zero));
+    const uint32x4_t special = vorrq_u32(subnormal, vceqq_u32(exponent, exponent_mask));
+    vst1q_f32(out + i, vreinterpretq_f32_u32(bits));
+    if (vmaxvq_u32(special) != 0) {
+      uint32_t lanes[4];
+      vst1q_u32(lanes, special);
+      patchSpecialLanes(
+        out + i, (lanes[0] & 1) | (lanes[1] & 2) | (lanes[2] & 4) | (lanes[3] & 8));
+    }
+  }
+#endif
+
+  for (; i < count; ++i) {
+    out[i] = decodeFloat32Auto(loadBigEndian(data + 4 * i));
+  }
+}
+
+}  // namespace vesc_driver
@@ -0,0 +1,211 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_framer.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+
+#include "vesc_driver/vesc_packet_factory.hpp"
+#include "vesc_driver/vesc_tracing.hpp"
+
+namespace vesc_driver
+{
+
+namespace
+{
+
+inline bool isStartOfFrame(uint8_t c)
+{
+  return VescFrame::VESC_SOF_VAL_SMALL_FRAME == c || VescFrame::VESC_SOF_VAL_LARGE_FRAME == c;
+}
+
+}  // namespace
+
+VescFramer::VescFramer(
+  const PacketHandlerFunction & packet_handler,
+  const ErrorHandlerFunction & error_handler)
+: packet_handler_(packet_handler), error_handler_(error_handler), sequence_(0),
+  stream_offset_(0), search_offset_(0), recheck_size_(UINT64_MAX)
+{
+  buffer_.reserve(2 * VescFrame::VESC_MAX_FRAME_SIZE);
+}
+
+void VescFramer::setPacketHandler(const PacketHandlerFunction & handler)
+{
+  packet_handler_ = handler;
+}
+
+void VescFramer::setErrorHandler(const ErrorHandlerFunction & handler)
+{
+  error_handler_ = handler;
+}
+
+void VescFramer::reset()
+{
+  stream_offset_ += buffer_.size();
+  buffer_.clear();
+  incomplete_.clear();
+  recheck_size_ = UINT64_MAX;
+}
+
+std::size_t VescFramer::buffered() const
+{
+  return buffer_.size();
+}
+
+void VescFramer::reportError(VescErrorCode error, std::size_t num_bytes) const
+{
+  if (error_handler_) {
+    error_handler_(error, num_bytes);
+  }
+}
+
+Buffer::const_iterator VescFramer::findValidFrame(
+  Buffer::const_iterator begin, Buffer::const_iterator end,
+  VescPacketPtr * packet)
+{
+  const uint64_t first = stream_offset_ + std::distance(buffer_.cbegin(), begin);
+  const uint64_t size = stream_offset_ + buffer_.size();
+
+  // candidates before the head are out of the running
+  while (!incomplete_.empty() && incomplete_.front().first < first) {
+    incomplete_.pop_front();
+  }
+  search_offset_ = std::max(search_offset_, first);
+
+  // candidates that were incomplete on an earlier pass, once enough bytes have arrived; they all
+  // precede the bytes not yet examined, so the first valid frame is still found first
+  if (size >= recheck_size_) {
+    recheck_size_ = UINT64_MAX;
+    for (auto pending = incomplete_.begin(); pending != incomplete_.end(); ) {
+      if (pending->second <= size) {
+        int bytes_needed = 0;
+        const Buffer::const_iterator iter = buffer_.cbegin() + (pending->first - stream_offset_);
+        *packet = VescPacketFactory::createPacket(iter, end, &bytes_needed, NULL);
+        if (*packet) {
+          return iter;
+        }
+        if (bytes_needed == 0) {
+          pending = incomplete_.erase(pending);
+          continue;
+        }
+        pending->second = size + bytes_needed;
+      }
+      recheck_size_ = std::min(recheck_size_, pending->second);
+      ++pending;
+    }
+  }
+
+  // createPacket() rejects incomplete frames and frames with a bad end-of-frame character before
+  // computing a checksum, so this stays cheap on noisy data
+  for (; search_offset_ < size; ++search_offset_) {
+    const Buffer::const_iterator iter = buffer_.cbegin() + (search_offset_ - stream_offset_);
+    if (isStartOfFrame(*iter)) {
+      int bytes_needed = 0;
+      *packet = VescPacketFactory::createPacket(iter, end, &bytes_needed, NULL);
+      if (*packet) {
+        ++search_offset_;
+        return iter;
+      }
+      if (bytes_needed > 0) {
+        incomplete_.emplace_back(search_offset_, size + bytes_needed);
+        recheck_size_ = std::min(recheck_size_, size + bytes_needed);
+      }
+    }
+  }
+  return end;
+}
+
+void VescFramer::push(const uint8_t * data, std::size_t size, int64_t stamp_ns)
+{
+  buffer_.insert(buffer_.end(), data, data + size);
+  if (buffer_.empty()) {
+    return;
+  }
+
+  // search buffer for valid packet(s)
+  Buffer::const_iterator iter = buffer_.begin();
+  Buffer::const_iterator iter_begin = buffer_.begin();
+  const Buffer::const_iterator end = buffer_.end();
+  while (iter != end) {
+    // check if valid start-of-frame character
+    if (!isStartOfFrame(*iter)) {
+      ++iter;
+      continue;
+    }
+
+    // good start, now attempt to create packet
+    int bytes_needed = 0;
+    VescErrorCode error = VESC_ERROR_NUM_CODES;
+    VescPacketPtr packet = VescPacketFactory::createPacket(iter, end, &bytes_needed, &error);
+    if (!packet && bytes_needed > 0) {
+      // the length field of this candidate has not been verified by a checksum, so only wait for
+      // more data if no later candidate already forms a valid frame
+      Buffer::const_iterator next = findValidFrame(iter + 1, end, &packet);
+      if (next == end) {
+        // need more data, break out of while loop
+        break;
+      }
+      iter = next;
+    }
+
+    if (packet) {
+      // good packet, check if we skipped any data
+      if (std::distance(iter_begin, iter) > 0) {
+        reportError(VESC_ERROR_OUT_OF_SYNC, std::distance(iter_begin, iter));
+      }
+      packet->sequence_ = ++sequence_;
+      packet->rx_stamp_ = stamp_ns;
+      VESC_TRACEPOINT(packet_created, sequence_, packet->payloadId(), packet->frame().size());
+      // call packet handler
+      if (packet_handler_) {
+        packet_handler_(packet);
+      }
+      // update state
+      iter = iter + packet->frame().size();
+      iter_begin = iter;
+    } else {
+      // this was not a packet, move on to next byte
+      reportError(error, 0);
+      ++iter;
+    }
+  }
+
+  // erase "used" buffer
+  if (std::distance(iter_begin, iter) > 0) {
+    reportError(VESC_ERROR_OUT_OF_SYNC, std::distance(iter_begin, iter));
+  }
+  stream_offset_ += std::distance(buffer_.cbegin(), iter);
+  buffer_.erase(buffer_.cbegin(), iter);
+}
+
+}  // namespace vesc_driver
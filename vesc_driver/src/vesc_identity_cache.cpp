@@ -0,0 +1,267 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_identity_cache.hpp"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace vesc_driver
+{
+
+namespace
+{
+
+/** Holds an flock() on the cache file for its scope. */
+class FileLock
+{
+public:
+  FileLock(int fd, int operation)
+  : fd_(fd)
+  {
+    while (flock(fd_, operation) != 0 && errno == EINTR) {}
+  }
+  ~FileLock()
+  {
+    flock(fd_, LOCK_UN);
+  }
+
+private:
+  int fd_;
+};
+
+/** Copies @p value into the fixed-size field @p field, truncating and always terminating it. */
+template<std::size_t N>
+void setField(char (& field)[N], const std::string & value)
+{
+  std::size_t size = std::min(value.size(), N - 1);
+  memcpy(field, value.data(), size);
+  memset(field + size, 0, N - size);
+}
+
+template<std::size_t N>
+bool fieldEquals(const char (& field)[N], const std::string & value)
+{
+  return value.size() < N && strncmp(field, value.c_str(), N) == 0;
+}
+
+}  // namespace
+
+std::string VescIdentity::uuidString() const
+{
+  char uuid_data[40];
+  snprintf(
+    uuid_data, sizeof(uuid_data),
+    "%02x%02x%02x-%02x%02x%02x-%02x%02x%02x-%02x%02x%02x",
+    uuid[0], uuid[1], uuid[2],
+    uuid[3], uuid[4], uuid[5],
+    uuid[6], uuid[7], uuid[8],
+    uuid[9], uuid[10], uuid[11]);
+  return uuid_data;
+}
+
+VescIdentityCache::VescIdentityCache(const std::string & path)
+: fd_(-1), map_(NULL),
+  size_(sizeof(VescIdentityCacheHeader) +
+    VESC_IDENTITY_CACHE_CAPACITY * sizeof(VescIdentityCacheEntry)),
+  entries_(NULL)
+{
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error("Failed to open identity cache " + path + ": " + strerror(errno));
+  }
+
+  FileLock lock(fd_, LOCK_EX);
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    ::close(fd_);
+    throw std::runtime_error("Failed to stat identity cache " + path + ": " + strerror(errno));
+  }
+  const bool fresh = static_cast<std::size_t>(st.st_size) != size_;
+  if (fresh && ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+    ::close(fd_);
+    throw std::runtime_error("Failed to size identity cache " + path + ": " + strerror(errno));
+  }
+
+  void * map = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    ::close(fd_);
+    throw std::runtime_error("Failed to map identity cache " + path + ": " + strerror(errno));
+  }
+  map_ = static_cast<uint8_t *>(map);
+  entries_ = reinterpret_cast<VescIdentityCacheEntry *>(map_ + sizeof(VescIdentityCacheHeader));
+
+  // start over if the file is new, truncated or from another version
+  VescIdentityCacheHeader * header = reinterpret_cast<VescIdentityCacheHeader *>(map_);
+  if (fresh || memcmp(header->magic, VESC_IDENTITY_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+    header->version != VESC_IDENTITY_CACHE_VERSION ||
+    header->capacity != VESC_IDENTITY_CACHE_CAPACITY)
+  {
+    memset(map_, 0, size_);
+    memcpy(header->magic, VESC_IDENTITY_CACHE_MAGIC, sizeof(header->magic));
+    header->version = VESC_IDENTITY_CACHE_VERSION;
+    header->capacity = VESC_IDENTITY_CACHE_CAPACITY;
+  }
+}
+
+VescIdentityCache::~VescIdentityCache()
+{
+  msync(map_, size_, MS_ASYNC);
+  munmap(map_, size_);
+  ::close(fd_);
+}
+
+VescIdentityCacheEntry * VescIdentityCache::findEntry(
+  const std::string & usb_serial, const std::string & path)
+{
+  for (uint32_t i = 0; i < VESC_IDENTITY_CACHE_CAPACITY; ++i) {
+    VescIdentityCacheEntry & entry = entries_[i];
+    if (entry.in_use && fieldEquals(entry.usb_serial, usb_serial) &&
+      fieldEquals(entry.path, path))
+    {
+      return &entry;
+    }
+  }
+  return NULL;
+}
+
+bool VescIdentityCache::find(
+  const std::string & usb_serial, const std::string & path, VescIdentity * identity)
+{
+  if (usb_serial.empty()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(mutex_);
+  FileLock lock(fd_, LOCK_SH);
+  const VescIdentityCacheEntry * entry = findEntry(usb_serial, path);
+  if (entry == NULL || entry->shared) {
+    return false;
+  }
+  std::copy(entry->uuid, entry->uuid + sizeof(entry->uuid), identity->uuid.begin());
+  identity->hwname.assign(entry->hwname, strnlen(entry->hwname, sizeof(entry->hwname)));
+  identity->fw_major = entry->fw_major;
+  identity->fw_minor = entry->fw_minor;
+  return true;
+}
+
+void VescIdentityCache::store(
+  const std::string & usb_serial, const std::string & path, const VescIdentity & identity)
+{
+  if (usb_serial.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(mutex_);
+  FileLock lock(fd_, LOCK_EX);
+
+  // one serial number with two UUIDs does not identify a unit, whatever the paths
+  bool shared = false;
+  for (uint32_t i = 0; i < VESC_IDENTITY_CACHE_CAPACITY; ++i) {
+    const VescIdentityCacheEntry & other = entries_[i];
+    if (other.in_use && fieldEquals(other.usb_serial, usb_serial) &&
+      (other.shared || !std::equal(identity.uuid.begin(), identity.uuid.end(), other.uuid)))
+    {
+      shared = true;
+    }
+  }
+  if (shared) {
+    for (uint32_t i = 0; i < VESC_IDENTITY_CACHE_CAPACITY; ++i) {
+      if (entries_[i].in_use && fieldEquals(entries_[i].usb_serial, usb_serial)) {
+        entries_[i].shared = 1;
+      }
+    }
+  }
+
+  VescIdentityCacheEntry * entry = findEntry(usb_serial, path);
+  if (entry == NULL) {
+    // take a free slot, or else the least recently stored one
+    entry = &entries_[0];
+    for (uint32_t i = 0; i < VESC_IDENTITY_CACHE_CAPACITY; ++i) {
+      if (!entries_[i].in_use) {
+        entry = &entries_[i];
+        break;
+      }
+      if (entries_[i].updated < entry->updated) {
+        entry = &entries_[i];
+      }
+    }
+  }
+
+  setField(entry->usb_serial, usb_serial);
+  setField(entry->path, path);
+  std::copy(identity.uuid.begin(), identity.uuid.end(), entry->uuid);
+  setField(entry->hwname, identity.hwname);
+  entry->fw_major = identity.fw_major;
+  entry->fw_minor = identity.fw_minor;
+  entry->updated = static_cast<int64_t>(time(NULL));
+  entry->in_use = 1;
+  entry->shared = shared ? 1 : 0;
+}
+
+void VescIdentityCache::invalidate(const std::string & usb_serial, const std::string & path)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  FileLock lock(fd_, LOCK_EX);
+  VescIdentityCacheEntry * entry = findEntry(usb_serial, path);
+  if (entry != NULL) {
+    entry->in_use = 0;
+  }
+}
+
+std::string usbSerialNumber(const std::string & port)
+{
+  char resolved[PATH_MAX];
+  if (realpath(port.c_str(), resolved) == NULL) {
+    return std::string();
+  }
+  std::string name(resolved);
+  name = name.substr(name.find_last_of('/') + 1);
+
+  // the tty's device is the USB interface, its parent the USB device carrying the serial number
+  std::ifstream serial_file("/sys/class/tty/" + name + "/device/../serial");
+  std::string serial;
+  std::getline(serial_file, serial);
+  return serial;
+}
+
+}  // namespace vesc_driver
@@ -30,8 +30,16 @@
 
 #include "vesc_driver/vesc_interface.hpp"
 
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <memory>
@@ -41,7 +49,11 @@
 #include <thread>
 #include <vector>
 
+#include "vesc_driver/vesc_capture.hpp"
+#include "vesc_driver/vesc_framer.hpp"
+#include "vesc_driver/vesc_link_stats.hpp"
 #include "vesc_driver/vesc_packet_factory.hpp"
+#include "vesc_driver/vesc_tracing.hpp"
 #include "serial_driver/serial_driver.hpp"
 
 namespace vesc_driver
@@ -52,20 +64,80 @@ class VescInterface::Impl
 public:
   Impl()
   : owned_ctx{new IoContext(2)},
-    serial_driver_{new drivers::serial_driver::SerialDriver(*owned_ctx)}
+    serial_driver_{new drivers::serial_driver::SerialDriver(*owned_ctx)},
+    framer_(
+      [this](const VescPacketConstPtr & packet) {
+        const int64_t rtt_ns = link_stats_.onReceive(*packet, packet->rxStamp());
+        if (rtt_ns >= 0) {
+          delay_estimator_.update(packet->rxStamp(), rtt_ns);
+        }
+        VESC_TRACEPOINT(packet_callback_begin, packet->sequence());
+        packet_handler_(packet);
+        VESC_TRACEPOINT(packet_callback_end, packet->sequence());
+      },
+      [this](VescErrorCode error, std::size_t num_bytes) {
+        error_counters_.add(error, num_bytes);
+        if (error_handler_) {
+          error_handler_(error, num_bytes);
+        }
+      }),
+    rx_run_(false),
+    rx_chunk_sequence_(0),
+    tx_sequence_(0),
+    tx_first_sequence_(0),
+    tx_batch_depth_(0),
+    tx_batch_window_(0),
+    tx_thread_run_(false),
+    link_failed_(false),
+    lock_fd_(-1)
   {}
-  void packet_creation_thread();
+  void receive(std::vector<uint8_t> & buffer, const std::size_t & bytes_read);
+  void tx_thread();
+  void flushTx();
   void on_configure();
   void connect(const std::string & port);
+  void lockPort(const std::string & port);
+  void unlockPort();
 
-  bool packet_thread_run_;
-  std::unique_ptr<std::thread> packet_thread_;
   PacketHandlerFunction packet_handler_;
   ErrorHandlerFunction error_handler_;
   std::unique_ptr<drivers::serial_driver::SerialPortConfig> device_config_;
   std::string device_name_;
   std::unique_ptr<IoContext> owned_ctx{};
   std::unique_ptr<drivers::serial_driver::SerialDriver> serial_driver_;
+  VescFramer framer_;
+
+  // reception runs on the IO context; rx_mutex_ lets disconnect() wait out a chunk in progress
+  std::mutex rx_mutex_;
+  bool rx_run_;                          ///< received chunks are framed, guarded by rx_mutex_
+  uint64_t rx_chunk_sequence_;           ///< guarded by rx_mutex_
+  std::shared_ptr<drivers::serial_driver::SerialPort> rx_port_;  ///< outlives a cancelled read
+  VescErrorCounters error_counters_;
+  VescLinkStats link_stats_;
+  VescDelayEstimator delay_estimator_;
+  std::shared_ptr<VescCaptureWriter> recorder_;
+  std::mutex recording_error_mutex_;
+  std::string recording_error_;          ///< why the last recording stopped early
+
+  /** Writes a chunk to the capture file, ending the recording if the write fails. */
+  void record(int64_t stamp_ns, VescCaptureDirection direction, const uint8_t * data, size_t size);
+
+  // transmit batching; tx_mutex_ guards the queue, tx_write_mutex_ keeps writes in order
+  std::mutex tx_mutex_;
+  std::mutex tx_write_mutex_;
+  std::condition_variable tx_condition_;
+  Buffer tx_buffer_;                     ///< frames waiting to be written
+  std::vector<int> tx_payload_ids_;      ///< payload ids of the frames in tx_buffer_
+  uint64_t tx_sequence_;                 ///< sequence number of the last frame queued
+  uint64_t tx_first_sequence_;           ///< sequence number of the first frame queued
+  int tx_batch_depth_;                   ///< number of TxBatch objects in scope
+  std::chrono::microseconds tx_batch_window_;
+  std::chrono::steady_clock::time_point tx_deadline_;  ///< when the queue must be written
+  bool tx_thread_run_;
+  std::unique_ptr<std::thread> tx_thread_;
+
+  std::atomic<bool> link_failed_;        ///< a write failed, the port must be reopened
+  int lock_fd_;                          ///< holds the flock() on the port, -1 if none
 
   ~Impl()
   {
@@ -73,74 +145,133 @@ public:
       owned_ctx->waitForExit();
     }
   }
-
-private:
-  std::vector<uint8_t> buffer_;
 };
 
-void VescInterface::Impl::packet_creation_thread()
-{
-  static auto temp_buffer = Buffer(2048, 0);
-  while (packet_thread_run_) {
-    const auto bytes_read = serial_driver_->port()->receive(temp_buffer);
-    buffer_.reserve(buffer_.size() + temp_buffer.size());
-    buffer_.insert(buffer_.end(), temp_buffer.begin(), temp_buffer.begin() + bytes_read);
-    int bytes_needed = VescFrame::VESC_MIN_FRAME_SIZE;
-    if (!buffer_.empty()) {
-      // search buffer for valid packet(s)
-      auto iter = buffer_.begin();
-      auto iter_begin = buffer_.begin();
-      while (iter != buffer_.end()) {
-        // check if valid start-of-frame character
-        if (VescFrame::VESC_SOF_VAL_SMALL_FRAME == *iter ||
-          VescFrame::VESC_SOF_VAL_LARGE_FRAME == *iter)
-        {
-          // good start, now attempt to create packet
-          std::string error;
-          VescPacketConstPtr packet =
-            VescPacketFactory::createPacket(iter, buffer_.end(), &bytes_needed, &error);
-          if (packet) {
-            // good packet, check if we skipped any data
-            if (std::distance(iter_begin, iter) > 0) {
-              std::ostringstream ss;
-              ss << "Out-of-sync with VESC, unknown data leading valid frame. Discarding " <<
-                std::distance(iter_begin, iter) << " bytes.";
-              error_handler_(ss.str());
-            }
-            // call packet handler
-            packet_handler_(packet);
-            // update state
-            iter = iter + packet->frame().size();
-            iter_begin = iter;
-            // continue to look for another frame in buffer
-            continue;
-          } else if (bytes_needed > 0) {
-            // need more data, break out of while loop
-            break;  // for (iter_sof...
-          } else {
-            // else, this was not a packet, move on to next byte
-            error_handler_(error);
-          }
-        }
+void VescInterface::Impl::receive(std::vector<uint8_t> & buffer, const std::size_t & bytes_read)
+{
+  // stamp the chunk before waiting for the lock
+  const int64_t stamp_ns = monotonicNanoseconds();
+  std::lock_guard<std::mutex> lock(rx_mutex_);
+  if (!rx_run_) {
+    return;
+  }
+  ++rx_chunk_sequence_;
+  VESC_TRACEPOINT(rx_chunk, rx_chunk_sequence_, bytes_read);
+  record(stamp_ns, CAPTURE_RX, buffer.data(), bytes_read);
+  framer_.push(buffer.data(), bytes_read, stamp_ns);
+}
 
-        iter++;
-      }
+void VescInterface::Impl::record(
+  int64_t stamp_ns, VescCaptureDirection direction, const uint8_t * data, size_t size)
+{
+  auto recorder = std::atomic_load(&recorder_);
+  if (!recorder || recorder->write(stamp_ns, direction, data, size)) {
+    return;
+  }
+  // only the thread that removes the failed recorder reports it
+  if (std::atomic_compare_exchange_strong(
+      &recorder_, &recorder, std::shared_ptr<VescCaptureWriter>()))
+  {
+    recorder->close();
+    std::lock_guard<std::mutex> lock(recording_error_mutex_);
+    recording_error_ = recorder->error();
+  }
+}
 
-      // if iter is at the end of the buffer, more bytes are needed
-      if (iter == buffer_.end()) {
-        bytes_needed = VescFrame::VESC_MIN_FRAME_SIZE;
+void VescInterface::Impl::tx_thread()
+{
+  // writes frames queued outside a TxBatch once the batch window has expired
+  std::unique_lock<std::mutex> lock(tx_mutex_);
+  while (tx_thread_run_) {
+    if (tx_buffer_.empty() || tx_batch_depth_ > 0 || tx_batch_window_.count() == 0) {
+      tx_condition_.wait(lock);
+    } else if (std::chrono::steady_clock::now() < tx_deadline_) {
+      tx_condition_.wait_until(lock, tx_deadline_);
+    } else {
+      lock.unlock();
+      try {
+        flushTx();
+      } catch (const SerialException &) {
+        // nobody to report to on this thread, the frames are dropped
       }
+      lock.lock();
+    }
+  }
+}
 
-      // erase "used" buffer
-      if (std::distance(iter_begin, iter) > 0) {
-        std::ostringstream ss;
-        ss << "Out-of-sync with VESC, discarding " << std::distance(iter_begin, iter) << " bytes.";
-        error_handler_(ss.str());
+void VescInterface::Impl::flushTx()
+{
+  std::lock_guard<std::mutex> write_lock(tx_write_mutex_);
+  Buffer frames;
+  std::vector<int> payload_ids;
+  uint64_t first_sequence, last_sequence;
+  {
+    std::lock_guard<std::mutex> lock(tx_mutex_);
+    if (tx_buffer_.empty()) {
+      return;
+    }
+    frames.swap(tx_buffer_);
+    payload_ids.swap(tx_payload_ids_);
+    first_sequence = tx_first_sequence_;
+    last_sequence = tx_sequence_;
+  }
+
+  // round trips are timed from the write, not from when the frames were queued; stamp before
+  // writing, so that no response can be received before its request is recorded
+  const int64_t stamp_ns = monotonicNanoseconds();
+  for (int payload_id : payload_ids) {
+    link_stats_.onSend(payload_id, stamp_ns);
+  }
+
+  // a synchronous write, the buffer only lives until the end of this function
+  const std::size_t size = frames.size();
+  try {
+    std::size_t written = serial_driver_->port()->send(frames);
+    while (written < frames.size()) {
+      // the port blocks until it can write, so writing nothing means it cannot make progress
+      if (written == 0) {
+        std::stringstream ss;
+        ss << "The port accepted only " << size - frames.size() << " bytes.";
+        throw std::runtime_error(ss.str());
       }
-      buffer_.erase(buffer_.begin(), iter);
+      frames.erase(frames.begin(), frames.begin() + written);
+      written = serial_driver_->port()->send(frames);
     }
-    // Only attempt to read every 5 ms
-    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  } catch (const std::exception & e) {
+    link_failed_ = true;
+    std::stringstream ss;
+    ss << "Failed to write " << size << " bytes to the VESC. " << e.what();
+    throw SerialException(ss.str().c_str());
+  }
+  VESC_TRACEPOINT(tx_write, first_sequence, last_sequence, size);
+  (void)first_sequence;
+  (void)last_sequence;
+  (void)size;
+}
+
+void VescInterface::Impl::lockPort(const std::string & port)
+{
+  // the serial driver does not expose its descriptor, so the lock is held on a second one; flock()
+  // locks the device for every process and descriptor, which keeps a UUID lookup or another
+  // driver from reading the replies meant for this one
+  lock_fd_ = ::open(port.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (lock_fd_ < 0) {
+    throw SerialException(strerror(errno));
+  }
+  if (flock(lock_fd_, LOCK_EX | LOCK_NB) != 0) {
+    const int error = errno;
+    unlockPort();
+    throw SerialException(
+            error == EWOULDBLOCK ? "The port is in use by another VESC interface." :
+            strerror(error));
+  }
+}
+
+void VescInterface::Impl::unlockPort()
+{
+  if (lock_fd_ >= 0) {
+    ::close(lock_fd_);
+    lock_fd_ = -1;
   }
 }
 
@@ -152,10 +283,18 @@ void VescInterface::Impl::connect(const std::string & port)
   auto sb = drivers::serial_driver::StopBits::ONE;
   device_config_ =
     std::make_unique<drivers::serial_driver::SerialPortConfig>(baud_rate, fc, pt, sb);
-  serial_driver_->init_port(port, *device_config_);
-  if (!serial_driver_->port()->is_open()) {
-    serial_driver_->port()->open();
+  lockPort(port);
+  try {
+    serial_driver_->init_port(port, *device_config_);
+    if (!serial_driver_->port()->is_open()) {
+      serial_driver_->port()->open();
+    }
+  } catch (...) {
+    unlockPort();
+    throw;
   }
+  // init_port() replaced the previous port, whose cancelled read completed when it was closed
+  rx_port_ = serial_driver_->port();
 }
 
 VescInterface::VescInterface(
@@ -193,7 +332,7 @@ void VescInterface::connect(const std::string & port)
 {
   // todo - mutex?
 
-  if (isConnected()) {
+  if (impl_->tx_thread_) {
     throw SerialException("Already connected to serial port.");
   }
 
@@ -206,23 +345,58 @@ void VescInterface::connect(const std::string & port)
     throw SerialException(ss.str().c_str());
   }
 
-  // start up a monitoring thread
-  impl_->packet_thread_run_ = true;
-  impl_->packet_thread_ = std::unique_ptr<std::thread>(
-    new std::thread(
-      &VescInterface::Impl::packet_creation_thread, impl_.get()));
+  // start receiving; a read failure is not reported by the port, the next write detects it
+  impl_->link_failed_ = false;
+  impl_->framer_.reset();
+  impl_->delay_estimator_.reset();
+  {
+    std::lock_guard<std::mutex> lock(impl_->rx_mutex_);
+    impl_->rx_run_ = true;
+    impl_->rx_chunk_sequence_ = 0;
+  }
+  Impl * impl = impl_.get();
+  impl_->rx_port_->async_receive(
+    [impl](std::vector<uint8_t> & buffer, const std::size_t & bytes_read) {
+      impl->receive(buffer, bytes_read);
+    });
+  impl_->tx_thread_run_ = true;
+  impl_->tx_thread_ = std::unique_ptr<std::thread>(
+    new std::thread(&VescInterface::Impl::tx_thread, impl_.get()));
 }
 
 void VescInterface::disconnect()
 {
   // todo - mutex?
 
-  if (isConnected()) {
-    // bring down read thread
-    impl_->packet_thread_run_ = false;
-    requestFWVersion();
-    impl_->packet_thread_->join();
-    impl_->serial_driver_->port()->close();
+  if (impl_->tx_thread_) {
+    // bring down transmit thread
+    {
+      std::lock_guard<std::mutex> lock(impl_->tx_mutex_);
+      impl_->tx_thread_run_ = false;
+    }
+    impl_->tx_condition_.notify_all();
+    impl_->tx_thread_->join();
+    impl_->tx_thread_.reset();
+
+    // stop framing, waiting for a chunk in progress; closing the port below cancels the pending
+    // read, so nothing is needed from the device
+    {
+      std::lock_guard<std::mutex> lock(impl_->rx_mutex_);
+      impl_->rx_run_ = false;
+    }
+
+    // drop whatever could not be written
+    {
+      std::lock_guard<std::mutex> lock(impl_->tx_mutex_);
+      impl_->tx_buffer_.clear();
+      impl_->tx_payload_ids_.clear();
+    }
+    try {
+      impl_->serial_driver_->port()->close();
+    } catch (const std::exception &) {
+      // closing a port whose device has gone away may fail, it is released either way
+    }
+    impl_->unlockPort();
   }
 }
 
@@ -230,7 +404,7 @@ bool VescInterface::isConnected() const
 {
   auto port = impl_->serial_driver_->port();
   if (port) {
-    return port->is_open();
+    return port->is_open() && !impl_->link_failed_;
   } else {
     return false;
   }
@@ -238,7 +412,110 @@ bool VescInterface::isConnected() const
 
 void VescInterface::send(const VescPacket & packet)
 {
-  impl_->serial_driver_->port()->async_send(packet.frame());
+  impl_->record(
+    monotonicNanoseconds(), CAPTURE_TX, packet.frame().data(), packet.frame().size());
+
+  bool write_now;
+  bool start_window = false;
+  {
+    std::lock_guard<std::mutex> lock(impl_->tx_mutex_);
+    const uint64_t sequence = ++impl_->tx_sequence_;
+    VESC_TRACEPOINT(tx_enqueue, sequence, packet.payloadId(), packet.frame().size());
+    if (impl_->tx_buffer_.empty()) {
+      impl_->tx_first_sequence_ = sequence;
+      impl_->tx_deadline_ = std::chrono::steady_clock::now() + impl_->tx_batch_window_;
+      start_window = true;
+    }
+    impl_->tx_buffer_.insert(impl_->tx_buffer_.end(), packet.frame().begin(), packet.frame().end());
+    impl_->tx_payload_ids_.push_back(packet.payloadId());
+    write_now = impl_->tx_batch_depth_ == 0 && impl_->tx_batch_window_.count() == 0;
+  }
+
+  if (write_now) {
+    impl_->flushTx();
+  } else if (start_window) {
+    impl_->tx_condition_.notify_one();
+  }
+}
+
+VescInterface::TxBatch::TxBatch(VescInterface & vesc)
+: vesc_(vesc)
+{
+  std::lock_guard<std::mutex> lock(vesc_.impl_->tx_mutex_);
+  ++vesc_.impl_->tx_batch_depth_;
+}
+
+VescInterface::TxBatch::~TxBatch()
+{
+  bool flush;
+  {
+    std::lock_guard<std::mutex> lock(vesc_.impl_->tx_mutex_);
+    flush = --vesc_.impl_->tx_batch_depth_ == 0;
+  }
+  if (flush) {
+    try {
+      vesc_.impl_->flushTx();
+    } catch (const SerialException &) {
+      // destructors must not throw, the frames are dropped
+    }
+  }
+}
+
+void VescInterface::setTxBatchWindow(std::chrono::microseconds window)
+{
+  {
+    std::lock_guard<std::mutex> lock(impl_->tx_mutex_);
+    impl_->tx_batch_window_ = std::max(window, std::chrono::microseconds(0));
+  }
+  // frames already queued are written by the next send or, with a window, by the tx thread
+  impl_->tx_condition_.notify_one();
+}
+
+void VescInterface::startRecording(const std::string & path)
+{
+  std::atomic_store(&impl_->recorder_, std::make_shared<VescCaptureWriter>(path));
+}
+
+void VescInterface::stopRecording()
+{
+  auto recorder = std::atomic_exchange(
+    &impl_->recorder_, std::shared_ptr<VescCaptureWriter>());
+  if (recorder && !recorder->close()) {
+    throw std::runtime_error(recorder->error());
+  }
+}
+
+std::string VescInterface::takeRecordingError()
+{
+  std::lock_guard<std::mutex> lock(impl_->recording_error_mutex_);
+  std::string error;
+  error.swap(impl_->recording_error_);
+  return error;
+}
+
+bool VescInterface::isRecording() const
+{
+  return static_cast<bool>(std::atomic_load(&impl_->recorder_));
+}
+
+VescErrorCounts VescInterface::errorCounts() const
+{
+  return impl_->error_counters_.snapshot();
+}
+
+VescLinkStats::Summary VescInterface::linkStats() const
+{
+  return impl_->link_stats_.summary();
+}
+
+VescDelayEstimator::Estimate VescInterface::delayEstimate() const
+{
+  return impl_->delay_estimator_.estimate();
+}
+
+int64_t VescInterface::sampleStamp(const VescFrame & frame) const
+{
+  return impl_->delay_estimator_.sampleStamp(frame.rxStamp());
 }
 
 void VescInterface::requestFWVersion()
@@ -246,6 +523,16 @@ void VescInterface::requestFWVersion()
   send(VescPacketRequestFWVersion());
 }
 
+void VescInterface::requestMcConf()
+{
+  send(VescPacketRequestMcConf());
+}
+
+void VescInterface::requestAppConf()
+{
+  send(VescPacketRequestAppConf());
+}
+
 void VescInterface::requestState()
 {
   send(VescPacketRequestValues());
@@ -281,9 +568,14 @@ void VescInterface::setServo(double servo)
   send(VescPacketSetServoPos(servo));
 }
 
-void VescInterface::requestImuData()
+void VescInterface::sendAlive()
+{
+  send(VescPacketAlive());
+}
+
+void VescInterface::requestImuData(uint16_t mask)
 {
-  send(VescPacketRequestImu());
+  send(VescPacketRequestImu(mask));
 }
 
 }  // namespace vesc_driver
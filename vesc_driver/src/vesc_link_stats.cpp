@@ -0,0 +1,135 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include "vesc_driver/vesc_link_stats.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "vesc_driver/datatypes.hpp"
+
+namespace vesc_driver
+{
+
+namespace
+{
+
+/** @return true if the VESC answers packets with this payload id. */
+bool expectsResponse(int payload_id)
+{
+  return payload_id == COMM_FW_VERSION || payload_id == COMM_GET_VALUES ||
+         payload_id == COMM_GET_IMU_DATA || payload_id == COMM_GET_MCCONF ||
+         payload_id == COMM_GET_APPCONF;
+}
+
+double percentile(std::vector<int64_t> * samples, double p)
+{
+  auto nth = samples->begin() + static_cast<std::size_t>(p * (samples->size() - 1) + 0.5);
+  std::nth_element(samples->begin(), nth, samples->end());
+  return *nth * 1e-9;
+}
+
+}  // namespace
+
+VescLinkStats::VescLinkStats(std::size_t window, int64_t timeout_ns)
+: timeout_ns_(timeout_ns),
+  rtt_(window),
+  rtt_next_(0),
+  rtt_full_(false),
+  num_lost_(0),
+  last_packet_ns_(-1)
+{
+}
+
+void VescLinkStats::onSend(int id, int64_t stamp_ns)
+{
+  if (!expectsResponse(id)) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::deque<int64_t> & pending = outstanding_[id];
+  while (!pending.empty() && stamp_ns - pending.front() > timeout_ns_) {
+    pending.pop_front();
+    num_lost_++;
+  }
+  pending.push_back(stamp_ns);
+}
+
+int64_t VescLinkStats::onReceive(const VescFrame & frame, int64_t stamp_ns)
+{
+  int id = frame.payloadId();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  last_packet_ns_ = stamp_ns;
+
+  auto search = outstanding_.find(id);
+  if (search == outstanding_.end()) {
+    return -1;
+  }
+  std::deque<int64_t> & pending = search->second;
+  while (!pending.empty() && stamp_ns - pending.front() > timeout_ns_) {
+    pending.pop_front();
+    num_lost_++;
+  }
+  if (pending.empty()) {
+    return -1;
+  }
+
+  int64_t rtt = stamp_ns - pending.front();
+  pending.pop_front();
+  rtt_[rtt_next_] = rtt;
+  rtt_next_ = (rtt_next_ + 1) % rtt_.size();
+  rtt_full_ = rtt_full_ || rtt_next_ == 0;
+  return rtt;
+}
+
+VescLinkStats::Summary VescLinkStats::summary() const
+{
+  Summary summary = Summary();
+  std::vector<int64_t> samples;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    samples.assign(rtt_.begin(), rtt_full_ ? rtt_.end() : rtt_.begin() + rtt_next_);
+    summary.num_lost = num_lost_;
+    summary.last_packet_ns = last_packet_ns_;
+  }
+
+  summary.num_samples = samples.size();
+  if (!samples.empty()) {
+    summary.rtt_p50 = percentile(&samples, 0.50);
+    summary.rtt_p95 = percentile(&samples, 0.95);
+    summary.rtt_p99 = percentile(&samples, 0.99);
+    summary.rtt_max = *std::max_element(samples.begin(), samples.end()) * 1e-9;
+  }
+  return summary;
+}
+
+}  // namespace vesc_driver
@@ -30,6 +30,7 @@
 
 #include "vesc_driver/vesc_packet.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <iterator>
 #include <memory>
@@ -37,6 +38,7 @@
 #include <cmath>
 
 #include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_float_decode.hpp"
 #include "vesc_driver/vesc_packet_factory.hpp"
 
 
@@ -46,6 +48,7 @@ namespace vesc_driver
 constexpr CRC::Parameters<crcpp_uint16, 16> VescFrame::CRC_TYPE;
 
 VescFrame::VescFrame(int payload_size)
+: sequence_(0), rx_stamp_(0)
 {
   assert(payload_size >= 0 && payload_size <= 1024);
 
@@ -69,6 +72,7 @@ VescFrame::VescFrame(int payload_size)
 }
 
 VescFrame::VescFrame(const BufferRangeConst & frame, const BufferRangeConst & payload)
+: sequence_(0), rx_stamp_(0)
 {
   /* VescPacketFactory::createPacket() should make sure that the input is valid, but run a few cheap
      checks anyway */
@@ -158,6 +162,114 @@ VescPacketRequestFWVersion::VescPacketRequestFWVersion()
   *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
 }
 
+VescPacketAlive::VescPacketAlive()
+: VescPacket("Alive", 1, COMM_ALIVE)
+{
+  uint16_t crc = CRC::Calculate(
+    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
+  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
+  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
+}
+
+/*------------------------------------------------------------------------------------------------*/
+
+VescPacketConf::VescPacketConf(const std::string & name, std::shared_ptr<VescFrame> raw)
+: VescPacket(name, raw)
+{
+}
+
+VescPacketConf::VescPacketConf(
+  const std::string & name, int payload_id, uint32_t signature,
+  const std::vector<uint8_t> & data)
+: VescPacket(name, 5 + static_cast<int>(data.size()), payload_id)
+{
+  *(payload_.first + 1) = static_cast<uint8_t>((signature >> 24) & 0xFF);
+  *(payload_.first + 2) = static_cast<uint8_t>((signature >> 16) & 0xFF);
+  *(payload_.first + 3) = static_cast<uint8_t>((signature >> 8) & 0xFF);
+  *(payload_.first + 4) = static_cast<uint8_t>(signature & 0xFF);
+  std::copy(data.begin(), data.end(), payload_.first + 5);
+
+  uint16_t crc = CRC::Calculate(
+    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
+  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
+  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
+}
+
+uint32_t VescPacketConf::signature() const
+{
+  if (std::distance(payload_.first, payload_.second) < 5) {
+    return 0;
+  }
+  return (static_cast<uint32_t>(*(payload_.first + 1)) << 24) |
+         (static_cast<uint32_t>(*(payload_.first + 2)) << 16) |
+         (static_cast<uint32_t>(*(payload_.first + 3)) << 8) |
+         static_cast<uint32_t>(*(payload_.first + 4));
+}
+
+BufferRangeConst VescPacketConf::data() const
+{
+  if (std::distance(payload_.first, payload_.second) < 5) {
+    return BufferRangeConst(payload_.second, payload_.second);
+  }
+  return BufferRangeConst(payload_.first + 5, payload_.second);
+}
+
+VescPacketMcConf::VescPacketMcConf(std::shared_ptr<VescFrame> raw)
+: VescPacketConf("McConf", raw)
+{
+}
+
+REGISTER_PACKET_TYPE(COMM_GET_MCCONF, VescPacketMcConf)
+
+VescPacketRequestMcConf::VescPacketRequestMcConf()
+: VescPacket("RequestMcConf", 1, COMM_GET_MCCONF)
+{
+  uint16_t crc = CRC::Calculate(
+    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
+  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
+  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
+}
+
+VescPacketSetMcConf::VescPacketSetMcConf(uint32_t signature, const std::vector<uint8_t> & data)
+: VescPacketConf("SetMcConf", COMM_SET_MCCONF, signature, data)
+{
+}
+
+VescPacketSetMcConfAck::VescPacketSetMcConfAck(std::shared_ptr<VescFrame> raw)
+: VescPacket("SetMcConfAck", raw)
+{
+}
+
+REGISTER_PACKET_TYPE(COMM_SET_MCCONF, VescPacketSetMcConfAck)
+
+VescPacketAppConf::VescPacketAppConf(std::shared_ptr<VescFrame> raw)
+: VescPacketConf("AppConf", raw)
+{
+}
+
+REGISTER_PACKET_TYPE(COMM_GET_APPCONF, VescPacketAppConf)
+
+VescPacketRequestAppConf::VescPacketRequestAppConf()
+: VescPacket("RequestAppConf", 1, COMM_GET_APPCONF)
+{
+  uint16_t crc = CRC::Calculate(
+    &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
+  *(frame_->end() - 3) = static_cast<uint8_t>(crc >> 8);
+  *(frame_->end() - 2) = static_cast<uint8_t>(crc & 0xFF);
+}
+
+VescPacketSetAppConf::VescPacketSetAppConf(uint32_t signature, const std::vector<uint8_t> & data)
+: VescPacketConf("SetAppConf", COMM_SET_APPCONF, signature, data)
+{
+}
+
+VescPacketSetAppConfAck::VescPacketSetAppConfAck(std::shared_ptr<VescFrame> raw)
+: VescPacket("SetAppConfAck", raw)
+{
+}
+
+REGISTER_PACKET_TYPE(COMM_SET_APPCONF, VescPacketSetAppConfAck)
+
 /*------------------------------------------------------------------------------------------------*/
 
 VescPacketValues::VescPacketValues(std::shared_ptr<VescFrame> raw)
@@ -535,26 +647,23 @@ VescPacketImu::VescPacketImu(std::shared_ptr<VescFrame> raw)
   );
   ind += 2;
 
-  if (mask_ & ((uint32_t)1 << 0)) {roll_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 1)) {pitch_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 2)) {yaw_ = getFloat32Auto(&ind);}
-
-  if (mask_ & ((uint32_t)1 << 3)) {acc_x_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 4)) {acc_y_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 5)) {acc_z_ = getFloat32Auto(&ind);}
-
-  if (mask_ & ((uint32_t)1 << 6)) {gyr_x_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 7)) {gyr_y_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 8)) {gyr_z_ = getFloat32Auto(&ind);}
-
-  if (mask_ & ((uint32_t)1 << 9)) {mag_x_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 10)) {mag_y_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 11)) {mag_z_ = getFloat32Auto(&ind);}
-
-  if (mask_ & ((uint32_t)1 << 12)) {q0_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 13)) {q1_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 14)) {q2_ = getFloat32Auto(&ind);}
-  if (mask_ & ((uint32_t)1 << 15)) {q3_ = getFloat32Auto(&ind);}
+  // the payload holds one float32_auto for each bit set in the mask, in bit order
+  double * const fields[16] = {
+    &roll_, &pitch_, &yaw_, &acc_x_, &acc_y_, &acc_z_, &gyr_x_, &gyr_y_, &gyr_z_,
+    &mag_x_, &mag_y_, &mag_z_, &q0_, &q1_, &q2_, &q3_};
+  std::size_t count = 0;
+  for (int bit = 0; bit < 16; ++bit) {
+    count += (mask_ >> bit) & 1;
+  }
+  const std::ptrdiff_t remaining = std::distance(payload_.first, payload_.second) - ind;
+  count = std::min<std::size_t>(count, remaining > 0 ? remaining / 4 : 0);
+
+  float values[16] = {};
+  decodeFloat32AutoBlock(&*(payload_.first + ind), count, values);
+  const float * value = values;
+  for (int bit = 0; bit < 16; ++bit) {
+    *fields[bit] = (mask_ & ((uint32_t)1 << bit)) ? *value++ : 0.0;
+  }
 }
 
 int VescPacketImu::mask() const
@@ -562,32 +671,9 @@ int VescPacketImu::mask() const
   return mask_;
 }
 
-double VescPacketImu::getFloat32Auto(uint32_t * idx) const
+bool VescPacketImu::has(uint16_t mask) const
 {
-  int pos = *idx;
-  uint32_t res = static_cast<uint32_t>(
-    (static_cast<uint32_t>(*(payload_.first + (pos ) )) << 24) +
-    (static_cast<uint32_t>(*(payload_.first + (pos + 1) )) << 16) +
-    (static_cast<uint32_t>(*(payload_.first + (pos + 2) )) << 8) +
-    static_cast<uint32_t>(*(payload_.first + (pos + 3) ))
-  );
-
-  *idx += 4;
-
-  int e = (res >> 23) & 0xFF;
-  int fr = res & 0x7FFFFF;
-  bool negative = res & (1u << 31);
-
-  float f = 0.0;
-  if (e != 0 || fr != 0) {
-    f = static_cast<float>(fr) / (8388608.0 * 2.0) + 0.5;
-    e -= 126;
-  }
-
-  if (negative) {
-    f = -f;
-  }
-  return ldexpf(f, e);
+  return (mask_ & mask) == mask;
 }
 
 double VescPacketImu::roll() const
@@ -674,11 +760,11 @@ double VescPacketImu::q_z() const
 
 REGISTER_PACKET_TYPE(COMM_GET_IMU_DATA, VescPacketImu)
 
-VescPacketRequestImu::VescPacketRequestImu()
+VescPacketRequestImu::VescPacketRequestImu(uint16_t mask)
 : VescPacket("RequestImuData", 3, COMM_GET_IMU_DATA)
 {
-  *(payload_.first + 1) = static_cast<uint8_t>(0xFF);
-  *(payload_.first + 2) = static_cast<uint8_t>(0xFF);
+  *(payload_.first + 1) = static_cast<uint8_t>(mask >> 8);
+  *(payload_.first + 2) = static_cast<uint8_t>(mask & 0xFF);
 
   uint16_t crc = CRC::Calculate(
     &(*payload_.first), std::distance(payload_.first, payload_.second), VescFrame::CRC_TYPE);
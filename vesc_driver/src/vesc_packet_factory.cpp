@@ -34,7 +34,6 @@
 #include <cassert>
 #include <iterator>
 #include <memory>
-#include <string>
 
 namespace vesc_driver
 {
@@ -55,28 +54,27 @@ void VescPacketFactory::registerPacketType(int payload_id, CreateFn fn)
 
 /** Helper function for when createPacket can not create a packet */
 VescPacketPtr createFailed(
-  int * p_num_bytes_needed, std::string * p_what,
-  const std::string & what, int num_bytes_needed = 0)
+  int * p_num_bytes_needed, VescErrorCode * p_error,
+  VescErrorCode error, int num_bytes_needed = 0)
 {
   if (p_num_bytes_needed != NULL) {*p_num_bytes_needed = num_bytes_needed;}
-  if (p_what != NULL) {*p_what = what;}
+  if (p_error != NULL) {*p_error = error;}
   return VescPacketPtr();
 }
 
 VescPacketPtr VescPacketFactory::createPacket(
   const Buffer::const_iterator & begin,
   const Buffer::const_iterator & end,
-  int * num_bytes_needed, std::string * what)
+  int * num_bytes_needed, VescErrorCode * error)
 {
   // initialize output variables
   if (num_bytes_needed != NULL) {*num_bytes_needed = 0;}
-  if (what != NULL) {what->clear();}
 
   // need at least VESC_MIN_FRAME_SIZE bytes in buffer
   int buffer_size(std::distance(begin, end));
   if (buffer_size < VescFrame::VESC_MIN_FRAME_SIZE) {
     return createFailed(
-      num_bytes_needed, what, "Buffer does not contain a complete frame",
+      num_bytes_needed, error, VESC_ERROR_INCOMPLETE_FRAME,
       VescFrame::VESC_MIN_FRAME_SIZE - buffer_size);
   }
 
@@ -84,7 +82,7 @@ VescPacketPtr VescPacketFactory::createPacket(
   if (VescFrame::VESC_SOF_VAL_SMALL_FRAME != *begin &&
     VescFrame::VESC_SOF_VAL_LARGE_FRAME != *begin)
   {
-    return createFailed(num_bytes_needed, what, "Buffer must begin with start-of-frame character");
+    return createFailed(num_bytes_needed, error, VESC_ERROR_NO_START_OF_FRAME);
   }
 
   // get a view of the payload
@@ -102,7 +100,7 @@ VescPacketPtr VescPacketFactory::createPacket(
 
   // check length
   if (std::distance(view_payload.first, view_payload.second) > VescFrame::VESC_MAX_PAYLOAD_SIZE) {
-    return createFailed(num_bytes_needed, what, "Invalid payload length");
+    return createFailed(num_bytes_needed, error, VESC_ERROR_INVALID_LENGTH);
   }
 
   // get iterators to crc field, end-of-frame field, and a view of the whole frame
@@ -114,13 +112,13 @@ VescPacketPtr VescPacketFactory::createPacket(
   int frame_size = std::distance(view_frame.first, view_frame.second);
   if (buffer_size < frame_size) {
     return createFailed(
-      num_bytes_needed, what, "Buffer does not contain a complete frame",
+      num_bytes_needed, error, VESC_ERROR_INCOMPLETE_FRAME,
       frame_size - buffer_size);
   }
 
   // is the end-of-frame character valid?
   if (VescFrame::VESC_EOF_VAL != *iter_eof) {
-    return createFailed(num_bytes_needed, what, "Invalid end-of-frame character");
+    return createFailed(num_bytes_needed, error, VESC_ERROR_INVALID_END_OF_FRAME);
   }
 
   // is the crc valid?
@@ -129,7 +127,7 @@ VescPacketPtr VescPacketFactory::createPacket(
       &(*view_payload.first), std::distance(view_payload.first, view_payload.second),
       VescFrame::CRC_TYPE))
   {
-    return createFailed(num_bytes_needed, what, "Invalid checksum");
+    return createFailed(num_bytes_needed, error, VESC_ERROR_INVALID_CHECKSUM);
   }
 
   // frame looks good, construct the raw frame
@@ -144,11 +142,11 @@ VescPacketPtr VescPacketFactory::createPacket(
       return search->second(raw_frame);
     } else {
       // no subclass constructor for this packet
-      return createFailed(num_bytes_needed, what, "Unkown payload type.");
+      return createFailed(num_bytes_needed, error, VESC_ERROR_UNKNOWN_PAYLOAD);
     }
   } else {
     // no payload
-    return createFailed(num_bytes_needed, what, "Frame does not have a payload");
+    return createFailed(num_bytes_needed, error, VESC_ERROR_EMPTY_PAYLOAD);
   }
 }
 
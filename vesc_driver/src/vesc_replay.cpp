@@ -0,0 +1,135 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "vesc_driver/vesc_capture.hpp"
+#include "vesc_driver/vesc_framer.hpp"
+#include "vesc_driver/vesc_packet.hpp"
+
+namespace
+{
+
+void usage(const char * name)
+{
+  std::cerr << "Usage: " << name << " [-r] [-t] [-q] <capture file>" << std::endl <<
+    "Replays a serial capture recorded by the VESC driver through the packet framer and prints " <<
+    "the resulting packet callback sequence." << std::endl <<
+    "  -r  replay at the original timing instead of as fast as possible" << std::endl <<
+    "  -t  also print chunks sent to the VESC" << std::endl <<
+    "  -q  only print the summary, e.g. for profiling the decoder" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  bool realtime = false;
+  bool print_tx = false;
+  bool quiet = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "rtqh")) != -1) {
+    switch (opt) {
+      case 'r': realtime = true; break;
+      case 't': print_tx = true; break;
+      case 'q': quiet = true; break;
+      default: usage(argv[0]); return opt == 'h' ? 0 : -1;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  std::unique_ptr<vesc_driver::VescCaptureReader> reader;
+  try {
+    reader.reset(new vesc_driver::VescCaptureReader(argv[optind]));
+  } catch (const std::runtime_error & e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  int64_t stamp_ns = 0;
+  uint64_t num_packets = 0;
+  uint64_t num_errors = 0;
+  uint64_t num_rx_bytes = 0;
+  vesc_driver::VescFramer framer(
+    [&](const vesc_driver::VescPacketConstPtr & packet) {
+      num_packets++;
+      if (!quiet) {
+        printf(
+          "%" PRId64 " RX %s %zu\n", stamp_ns, packet->name().c_str(), packet->frame().size());
+      }
+    },
+    [&](vesc_driver::VescErrorCode error, std::size_t num_bytes) {
+      num_errors++;
+      if (!quiet) {
+        printf(
+          "%" PRId64 " ERROR %s %zu\n", stamp_ns, vesc_driver::vescErrorString(error), num_bytes);
+      }
+    });
+
+  const auto wall_start = std::chrono::steady_clock::now();
+  int64_t first_stamp_ns = -1;
+  vesc_driver::VescCaptureReader::Record record;
+  while (reader->next(&record)) {
+    stamp_ns = record.stamp_ns;
+    if (first_stamp_ns < 0) {
+      first_stamp_ns = stamp_ns;
+    }
+    if (realtime) {
+      std::this_thread::sleep_until(
+        wall_start + std::chrono::nanoseconds(stamp_ns - first_stamp_ns));
+    }
+
+    if (record.direction == vesc_driver::CAPTURE_RX) {
+      num_rx_bytes += record.size;
+      framer.push(record.data, record.size, record.stamp_ns);
+    } else if (print_tx && !quiet) {
+      printf("%" PRId64 " TX %zu\n", stamp_ns, record.size);
+    }
+  }
+
+  const double elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - wall_start).count();
+  fprintf(
+    stderr, "%" PRIu64 " packets, %" PRIu64 " errors, %" PRIu64 " bytes in %.3f s (%.1f MB/s)\n",
+    num_packets, num_errors, num_rx_bytes, elapsed,
+    elapsed > 0.0 ? num_rx_bytes / elapsed / 1e6 : 0.0);
+  return 0;
+}
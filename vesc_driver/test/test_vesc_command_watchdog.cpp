@@ -0,0 +1,135 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "vesc_driver/vesc_command_watchdog.hpp"
+
+using vesc_driver::VescCommandWatchdog;
+
+namespace
+{
+
+const int64_t MS = 1000000;
+
+/**
+ * Runs the driver's keepalive timer every @p keepalive_period_ms against commands arriving every
+ * 20 ms until @p commands_stop_ms, and returns the times at which a keepalive went out.
+ */
+std::vector<int64_t> keepaliveTimes(
+  VescCommandWatchdog & watchdog, int64_t commands_stop_ms, int64_t keepalive_period_ms,
+  int64_t end_ms)
+{
+  std::vector<int64_t> sent;
+  // start well clear of 0, which stands for no command
+  const int64_t start_ns = 1000 * MS;
+  for (int64_t t_ms = 0; t_ms <= end_ms; t_ms++) {
+    const int64_t now_ns = start_ns + t_ms * MS;
+    if (t_ms < commands_stop_ms && t_ms % 20 == 0) {
+      watchdog.commandReceived(now_ns);
+    }
+    if (t_ms % keepalive_period_ms == 0 && watchdog.keepaliveDue(now_ns)) {
+      sent.push_back(t_ms);
+    }
+  }
+  return sent;
+}
+
+}  // namespace
+
+TEST(VescCommandWatchdog, KeepalivesStopOnceCommandsStop)
+{
+  VescCommandWatchdog watchdog;
+  watchdog.setTimeout(0.1);
+  const std::vector<int64_t> sent = keepaliveTimes(watchdog, 1000, 10, 3000);
+
+  // one keepalive per period while commands arrive, the last command was at 980 ms
+  ASSERT_FALSE(sent.empty());
+  EXPECT_EQ(sent.front(), 0);
+  EXPECT_EQ(sent.size(), 1080u / 10 + 1);
+  EXPECT_EQ(sent.back(), 1080);
+}
+
+TEST(VescCommandWatchdog, KeepalivesResumeWithCommands)
+{
+  VescCommandWatchdog watchdog;
+  watchdog.setTimeout(0.1);
+  const int64_t start_ns = 1000 * MS;
+  watchdog.commandReceived(start_ns);
+  EXPECT_FALSE(watchdog.keepaliveDue(start_ns + 500 * MS));
+  watchdog.commandReceived(start_ns + 600 * MS);
+  EXPECT_TRUE(watchdog.keepaliveDue(start_ns + 650 * MS));
+}
+
+TEST(VescCommandWatchdog, NoKeepalivesWithoutTimeout)
+{
+  // with command_timeout off nothing would ever stop a stalled command, so the VESC's own timeout
+  // must be left to trip
+  VescCommandWatchdog watchdog;
+  EXPECT_TRUE(keepaliveTimes(watchdog, 3000, 10, 3000).empty());
+}
+
+TEST(VescCommandWatchdog, NoKeepalivesBeforeFirstCommand)
+{
+  VescCommandWatchdog watchdog;
+  watchdog.setTimeout(0.1);
+  EXPECT_TRUE(keepaliveTimes(watchdog, 0, 10, 1000).empty());
+}
+
+TEST(VescCommandWatchdog, ResetForgetsLastCommand)
+{
+  VescCommandWatchdog watchdog;
+  watchdog.setTimeout(0.1);
+  const int64_t start_ns = 1000 * MS;
+  watchdog.commandReceived(start_ns);
+  EXPECT_TRUE(watchdog.keepaliveDue(start_ns + 50 * MS));
+  watchdog.reset();
+  EXPECT_FALSE(watchdog.keepaliveDue(start_ns + 50 * MS));
+  EXPECT_FALSE(watchdog.expired(start_ns + 500 * MS));
+  EXPECT_LT(watchdog.age(start_ns), 0.0);
+}
+
+TEST(VescCommandWatchdog, ExpiresAfterTimeout)
+{
+  VescCommandWatchdog watchdog;
+  watchdog.setTimeout(0.1);
+  const int64_t start_ns = 1000 * MS;
+  EXPECT_FALSE(watchdog.expired(start_ns));
+  watchdog.commandReceived(start_ns);
+  EXPECT_FALSE(watchdog.expired(start_ns + 100 * MS));
+  EXPECT_TRUE(watchdog.expired(start_ns + 101 * MS));
+  EXPECT_DOUBLE_EQ(watchdog.age(start_ns + 101 * MS), 0.101);
+
+  watchdog.setTimeout(0.0);
+  EXPECT_FALSE(watchdog.expired(start_ns + 101 * MS));
+}
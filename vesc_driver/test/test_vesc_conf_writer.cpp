@@ -0,0 +1,377 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_conf_writer.hpp"
+#include "vesc_driver/vesc_configuration.hpp"
+#include "vesc_driver/vesc_packet.hpp"
+#include "vesc_driver/vesc_packet_factory.hpp"
+
+using vesc_driver::Buffer;
+using vesc_driver::VescConfBlob;
+using vesc_driver::VescConfCodec;
+using vesc_driver::VescConfField;
+using vesc_driver::VescFrame;
+using vesc_driver::VescMcConfWriter;
+using vesc_driver::VescPacket;
+using vesc_driver::mc_configuration;
+
+namespace
+{
+
+#define MC_FLOAT(field) \
+  {#field, vesc_driver::CONF_FIELD_FLOAT32_AUTO, offsetof(mc_configuration, field)}
+
+/** Not any release's layout, but like them too large for a small frame. */
+const std::vector<VescConfField> TEST_FIELDS = {
+  MC_FLOAT(l_current_max), MC_FLOAT(l_current_min), MC_FLOAT(l_in_current_max),
+  MC_FLOAT(l_in_current_min), MC_FLOAT(l_abs_current_max), MC_FLOAT(l_min_erpm),
+  MC_FLOAT(l_max_erpm), MC_FLOAT(l_erpm_start), MC_FLOAT(l_max_erpm_fbrake),
+  MC_FLOAT(l_max_erpm_fbrake_cc), MC_FLOAT(l_min_vin), MC_FLOAT(l_max_vin),
+  MC_FLOAT(l_battery_cut_start), MC_FLOAT(l_battery_cut_end), MC_FLOAT(l_temp_fet_start),
+  MC_FLOAT(l_temp_fet_end), MC_FLOAT(l_temp_motor_start), MC_FLOAT(l_temp_motor_end),
+  MC_FLOAT(l_temp_accel_dec), MC_FLOAT(l_min_duty), MC_FLOAT(l_max_duty), MC_FLOAT(l_watt_max),
+  MC_FLOAT(l_watt_min), MC_FLOAT(l_current_max_scale), MC_FLOAT(l_current_min_scale),
+  MC_FLOAT(l_duty_start), MC_FLOAT(sl_min_erpm), MC_FLOAT(sl_min_erpm_cycle_int_limit),
+  MC_FLOAT(sl_max_fullbreak_current_dir_change), MC_FLOAT(sl_cycle_int_limit),
+  MC_FLOAT(sl_phase_advance_at_br), MC_FLOAT(sl_cycle_int_rpm_br), MC_FLOAT(sl_bemf_coupling_k),
+  MC_FLOAT(hall_sl_erpm), MC_FLOAT(foc_current_kp), MC_FLOAT(foc_current_ki),
+  MC_FLOAT(foc_f_sw), MC_FLOAT(foc_dt_us), MC_FLOAT(foc_encoder_offset),
+  MC_FLOAT(foc_encoder_ratio), MC_FLOAT(foc_encoder_sin_offset), MC_FLOAT(foc_encoder_sin_gain),
+  MC_FLOAT(foc_encoder_cos_offset), MC_FLOAT(foc_encoder_cos_gain),
+  MC_FLOAT(foc_encoder_sincos_filter_constant), MC_FLOAT(foc_motor_l), MC_FLOAT(foc_motor_r),
+  MC_FLOAT(foc_motor_flux_linkage), MC_FLOAT(foc_observer_gain),
+  MC_FLOAT(foc_observer_gain_slow), MC_FLOAT(foc_pll_kp), MC_FLOAT(foc_pll_ki),
+  MC_FLOAT(foc_duty_dowmramp_kp), MC_FLOAT(foc_duty_dowmramp_ki), MC_FLOAT(foc_openloop_rpm),
+  MC_FLOAT(foc_sl_openloop_hyst), MC_FLOAT(foc_sl_openloop_time),
+  MC_FLOAT(foc_sl_d_current_duty), MC_FLOAT(foc_sl_d_current_factor), MC_FLOAT(foc_sl_erpm),
+  MC_FLOAT(s_pid_kp), MC_FLOAT(s_pid_ki), MC_FLOAT(s_pid_kd), MC_FLOAT(s_pid_kd_filter),
+  MC_FLOAT(s_pid_min_erpm), MC_FLOAT(p_pid_kp), MC_FLOAT(p_pid_ki), MC_FLOAT(p_pid_kd),
+  MC_FLOAT(p_pid_kd_filter), MC_FLOAT(p_pid_ang_div), MC_FLOAT(si_gear_ratio),
+  MC_FLOAT(si_wheel_diameter),
+};
+
+#undef MC_FLOAT
+
+const uint32_t TEST_SIGNATURE = 0x12345678;
+const std::chrono::milliseconds TIMEOUT(20);
+
+/** Frames @p payload as the VESC sends it and parses it back, as VescInterface would. */
+vesc_driver::VescPacketConstPtr receive(const Buffer & payload)
+{
+  Buffer frame;
+  if (payload.size() < 256) {
+    frame.push_back(VescFrame::VESC_SOF_VAL_SMALL_FRAME);
+  } else {
+    frame.push_back(VescFrame::VESC_SOF_VAL_LARGE_FRAME);
+    frame.push_back(static_cast<uint8_t>(payload.size() >> 8));
+  }
+  frame.push_back(static_cast<uint8_t>(payload.size() & 0xFF));
+  frame.insert(frame.end(), payload.begin(), payload.end());
+  const uint16_t crc = CRC::Calculate(payload.data(), payload.size(), VescFrame::CRC_TYPE);
+  frame.push_back(static_cast<uint8_t>(crc >> 8));
+  frame.push_back(static_cast<uint8_t>(crc & 0xFF));
+  frame.push_back(VescFrame::VESC_EOF_VAL);
+
+  int num_bytes_needed = 0;
+  vesc_driver::VescErrorCode error;
+  return vesc_driver::VescPacketFactory::createPacket(
+    frame.begin(), frame.end(), &num_bytes_needed, &error);
+}
+
+/**
+ * A VESC holding a motor configuration, answering the writer from within its send function.
+ * Replies can be dropped to time the writer out, and writes altered as a firmware clamping a
+ * value would.
+ */
+class FakeVesc
+{
+public:
+  explicit FakeVesc(const VescConfCodec<mc_configuration> & codec)
+  : codec_(codec), signature(TEST_SIGNATURE), data(codec.size()), drop(-1), clamp(false),
+    writer(NULL)
+  {
+  }
+
+  void hold(const mc_configuration & conf)
+  {
+    codec_.encode(conf, data.data());
+  }
+
+  mc_configuration conf() const
+  {
+    mc_configuration conf = mc_configuration();
+    EXPECT_TRUE(codec_.decode(signature, data.data(), data.size(), &conf));
+    return conf;
+  }
+
+  void send(const VescPacket & packet)
+  {
+    sent.push_back(packet.frame());
+    if (static_cast<int>(sent.size()) - 1 == drop) {
+      return;
+    }
+    if (packet.payloadId() == vesc_driver::COMM_SET_MCCONF) {
+      const auto & set = dynamic_cast<const vesc_driver::VescPacketConf &>(packet);
+      signature = set.signature();
+      data.assign(set.data().first, set.data().second);
+      if (clamp) {
+        mc_configuration clamped = conf();
+        clamped.l_current_max = 40.0f;
+        hold(clamped);
+      }
+      ASSERT_TRUE(writer->handlePacket(*receive({vesc_driver::COMM_SET_MCCONF})));
+    } else if (packet.payloadId() == vesc_driver::COMM_GET_MCCONF) {
+      Buffer reply = {
+        vesc_driver::COMM_GET_MCCONF, static_cast<uint8_t>(signature >> 24),
+        static_cast<uint8_t>(signature >> 16), static_cast<uint8_t>(signature >> 8),
+        static_cast<uint8_t>(signature)};
+      reply.insert(reply.end(), data.begin(), data.end());
+      ASSERT_TRUE(writer->handlePacket(*receive(reply)));
+    }
+  }
+
+  /** @return Payload ids of the packets sent to the VESC, in order. */
+  std::vector<int> sentIds() const
+  {
+    std::vector<int> ids;
+    for (const auto & frame : sent) {
+      const std::size_t header = frame[0] == VescFrame::VESC_SOF_VAL_LARGE_FRAME ? 3 : 2;
+      ids.push_back(frame[header]);
+    }
+    return ids;
+  }
+
+private:
+  const VescConfCodec<mc_configuration> & codec_;
+
+public:
+  uint32_t signature;
+  Buffer data;
+  int drop;               ///< index of the packet left unanswered, -1 for none
+  bool clamp;             ///< store l_current_max as 40 A whatever is written
+  VescMcConfWriter * writer;
+  std::vector<Buffer> sent;
+};
+
+class VescConfWriterTest : public ::testing::Test
+{
+protected:
+  VescConfWriterTest()
+  : codec_(5, 2, TEST_SIGNATURE, TEST_FIELDS), vesc_(codec_),
+    writer_(codec_, [this](const VescPacket & packet) {vesc_.send(packet);})
+  {
+    vesc_.writer = &writer_;
+    on_vesc_ = mc_configuration();
+    on_vesc_.l_current_max = 50.0f;
+    on_vesc_.l_current_min = -50.0f;
+    on_vesc_.foc_motor_r = 0.02f;
+    vesc_.hold(on_vesc_);
+  }
+
+  VescConfBlob blob(const mc_configuration & conf) const
+  {
+    VescConfBlob blob;
+    blob.fw_major = 5;
+    blob.fw_minor = 2;
+    blob.signature = TEST_SIGNATURE;
+    blob.data.resize(codec_.size());
+    codec_.encode(conf, blob.data.data());
+    return blob;
+  }
+
+  VescConfCodec<mc_configuration> codec_;
+  FakeVesc vesc_;
+  VescMcConfWriter writer_;
+  mc_configuration on_vesc_;    ///< what the VESC holds at the start
+};
+
+const std::vector<int> READ = {vesc_driver::COMM_GET_MCCONF};
+const std::vector<int> READ_WRITE_READ = {
+  vesc_driver::COMM_GET_MCCONF, vesc_driver::COMM_SET_MCCONF, vesc_driver::COMM_GET_MCCONF};
+
+}  // namespace
+
+TEST_F(VescConfWriterTest, UnchangedWhenCacheAlreadyMatches)
+{
+  std::vector<std::string> changed = {"stale"};
+  VescConfBlob readback;
+  EXPECT_EQ(
+    writer_.write(blob(on_vesc_), on_vesc_, TIMEOUT, &changed, &readback),
+    vesc_driver::CONF_WRITE_UNCHANGED);
+  EXPECT_TRUE(vesc_.sent.empty());
+  EXPECT_TRUE(changed.empty());
+  EXPECT_TRUE(readback.data.empty());
+}
+
+TEST_F(VescConfWriterTest, UnchangedWhenVescAlreadyMatches)
+{
+  // the cache is older than the VESC, which was set to 60 A since
+  mc_configuration cached = on_vesc_;
+  on_vesc_.l_current_max = 60.0f;
+  vesc_.hold(on_vesc_);
+  mc_configuration desired = cached;
+  desired.l_current_max = 60.0f;
+
+  std::vector<std::string> changed;
+  VescConfBlob readback;
+  EXPECT_EQ(
+    writer_.write(blob(cached), desired, TIMEOUT, &changed, &readback),
+    vesc_driver::CONF_WRITE_UNCHANGED);
+  EXPECT_EQ(vesc_.sentIds(), READ);
+  EXPECT_TRUE(changed.empty());
+  EXPECT_EQ(readback.signature, TEST_SIGNATURE);
+  EXPECT_EQ(readback.data, vesc_.data);
+}
+
+TEST_F(VescConfWriterTest, VerifiedKeepsWhatOnlyTheVescHolds)
+{
+  // the cache is older than the VESC, whose motor resistance was measured since
+  mc_configuration cached = on_vesc_;
+  on_vesc_.foc_motor_r = 0.03f;
+  vesc_.hold(on_vesc_);
+  mc_configuration desired = cached;
+  desired.l_current_max = 60.0f;
+
+  std::vector<std::string> changed;
+  VescConfBlob readback;
+  EXPECT_EQ(
+    writer_.write(blob(cached), desired, TIMEOUT, &changed, &readback),
+    vesc_driver::CONF_WRITE_VERIFIED);
+  EXPECT_EQ(vesc_.sentIds(), READ_WRITE_READ);
+  EXPECT_EQ(changed, std::vector<std::string>({"l_current_max"}));
+
+  const mc_configuration now = vesc_.conf();
+  EXPECT_EQ(now.l_current_max, 60.0f);
+  EXPECT_EQ(now.l_current_min, -50.0f);
+  EXPECT_EQ(now.foc_motor_r, 0.03f);
+  EXPECT_EQ(readback.signature, TEST_SIGNATURE);
+  EXPECT_EQ(readback.data, vesc_.data);
+}
+
+TEST_F(VescConfWriterTest, SetIsSentAsLargeFrame)
+{
+  mc_configuration desired = on_vesc_;
+  desired.l_current_max = 60.0f;
+  ASSERT_EQ(
+    writer_.write(blob(on_vesc_), desired, TIMEOUT), vesc_driver::CONF_WRITE_VERIFIED);
+  ASSERT_EQ(vesc_.sent.size(), 3u);
+
+  // id, signature and fields, more than a small frame's 255 bytes
+  const Buffer & set = vesc_.sent[1];
+  const std::size_t payload_size = 1 + 4 + codec_.size();
+  ASSERT_GT(payload_size, 255u);
+  ASSERT_EQ(set.size(), 3 + payload_size + 3);
+  EXPECT_EQ(set[0], static_cast<uint8_t>(VescFrame::VESC_SOF_VAL_LARGE_FRAME));
+  EXPECT_EQ(set[1], payload_size >> 8);
+  EXPECT_EQ(set[2], payload_size & 0xFF);
+  EXPECT_EQ(set[3], vesc_driver::COMM_SET_MCCONF);
+  EXPECT_EQ(set.back(), static_cast<uint8_t>(VescFrame::VESC_EOF_VAL));
+  EXPECT_NE(receive(Buffer(set.begin() + 3, set.end() - 3)), nullptr);
+}
+
+TEST_F(VescConfWriterTest, MismatchWhenVescStoresSomethingElse)
+{
+  vesc_.clamp = true;
+  mc_configuration desired = on_vesc_;
+  desired.l_current_max = 60.0f;
+
+  std::vector<std::string> changed;
+  VescConfBlob readback;
+  EXPECT_EQ(
+    writer_.write(blob(on_vesc_), desired, TIMEOUT, &changed, &readback),
+    vesc_driver::CONF_WRITE_MISMATCH);
+  EXPECT_EQ(vesc_.sentIds(), READ_WRITE_READ);
+  EXPECT_EQ(changed, std::vector<std::string>({"l_current_max"}));
+
+  // the readback is what the VESC holds, not what was asked for
+  mc_configuration held = mc_configuration();
+  ASSERT_TRUE(
+    codec_.decode(readback.signature, readback.data.data(), readback.data.size(), &held));
+  EXPECT_EQ(held.l_current_max, 40.0f);
+}
+
+TEST_F(VescConfWriterTest, TimeoutAtEachExchange)
+{
+  mc_configuration desired = on_vesc_;
+  desired.l_current_max = 60.0f;
+
+  for (int drop = 0; drop < 3; drop++) {
+    SCOPED_TRACE(drop);
+    vesc_.hold(on_vesc_);
+    vesc_.sent.clear();
+    vesc_.drop = drop;
+    EXPECT_EQ(
+      writer_.write(blob(on_vesc_), desired, TIMEOUT), vesc_driver::CONF_WRITE_TIMEOUT);
+    EXPECT_EQ(vesc_.sentIds(), std::vector<int>(READ_WRITE_READ.begin(),
+      READ_WRITE_READ.begin() + drop + 1));
+  }
+
+  // a reply arriving after its timeout is not taken for the next one
+  vesc_.hold(on_vesc_);
+  vesc_.drop = -1;
+  EXPECT_FALSE(writer_.handlePacket(*receive({vesc_driver::COMM_SET_MCCONF})));
+  EXPECT_EQ(
+    writer_.write(blob(on_vesc_), desired, TIMEOUT), vesc_driver::CONF_WRITE_VERIFIED);
+}
+
+TEST_F(VescConfWriterTest, RefusedWhenVescSendsOtherLayout)
+{
+  vesc_.signature = TEST_SIGNATURE + 1;
+  mc_configuration desired = on_vesc_;
+  desired.l_current_max = 60.0f;
+
+  VescConfBlob readback;
+  EXPECT_EQ(
+    writer_.write(blob(on_vesc_), desired, TIMEOUT, NULL, &readback),
+    vesc_driver::CONF_WRITE_REFUSED);
+  EXPECT_EQ(vesc_.sentIds(), READ);
+  EXPECT_TRUE(readback.data.empty());
+}
+
+TEST_F(VescConfWriterTest, RejectsCurrentOfOtherLayout)
+{
+  VescConfBlob current = blob(on_vesc_);
+  current.fw_minor = 1;
+  EXPECT_THROW(writer_.write(current, on_vesc_, TIMEOUT), std::invalid_argument);
+  current = blob(on_vesc_);
+  current.signature = TEST_SIGNATURE + 1;
+  EXPECT_THROW(writer_.write(current, on_vesc_, TIMEOUT), std::invalid_argument);
+  EXPECT_TRUE(vesc_.sent.empty());
+}
@@ -0,0 +1,259 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/vesc_configuration.hpp"
+#include "vesc_driver/vesc_float_decode.hpp"
+
+using vesc_driver::VescConfBlob;
+using vesc_driver::VescConfCodec;
+using vesc_driver::VescConfField;
+using vesc_driver::app_configuration;
+using vesc_driver::mc_configuration;
+
+namespace
+{
+
+/**
+ * Checks every registered codec against the reply captured from its release, as saved by
+ * `vesc_config_tool -s test/data/fw<major>.<minor>.<kind> <port> <kind>`. A release without a
+ * capture fails, it must not be registered.
+ */
+template<typename Conf>
+void checkCaptures(const std::vector<VescConfCodec<Conf>> & codecs, const std::string & kind)
+{
+  for (const auto & codec : codecs) {
+    const std::string path = std::string(VESC_CONF_TEST_DATA) + "/fw" +
+      std::to_string(codec.fwMajor()) + "." + std::to_string(codec.fwMinor()) + "." + kind;
+    SCOPED_TRACE(path);
+    VescConfBlob capture;
+    ASSERT_TRUE(vesc_driver::loadConfBlob(path, &capture)) << "no captured reply";
+    EXPECT_EQ(capture.fw_major, codec.fwMajor());
+    EXPECT_EQ(capture.fw_minor, codec.fwMinor());
+
+    Conf conf = Conf();
+    ASSERT_TRUE(codec.decode(capture.signature, capture.data.data(), capture.data.size(), &conf))
+      << "signature " << capture.signature << " size " << capture.data.size() << ", codec has " <<
+      codec.signature() << " size " << codec.size();
+    std::vector<uint8_t> encoded(codec.size());
+    codec.encode(conf, encoded.data());
+    EXPECT_EQ(encoded, capture.data);
+  }
+}
+
+#define MC_FIELD(field, type) {#field, vesc_driver::type, offsetof(mc_configuration, field)}
+#define APP_FIELD(field, type) {#field, vesc_driver::type, offsetof(app_configuration, field)}
+
+/** One field of each type, not any release's layout. */
+const std::vector<VescConfField> MC_TEST_FIELDS = {
+  MC_FIELD(pwm_mode, CONF_FIELD_ENUM_U8),
+  MC_FIELD(l_current_max, CONF_FIELD_FLOAT32_AUTO),
+  MC_FIELD(l_slow_abs_current, CONF_FIELD_BOOL),
+  MC_FIELD(hall_table[0], CONF_FIELD_INT8),
+  MC_FIELD(foc_hall_table[0], CONF_FIELD_UINT8),
+  MC_FIELD(m_drv8301_oc_adj, CONF_FIELD_INT_U8),
+  MC_FIELD(gpd_buffer_notify_left, CONF_FIELD_INT_I16),
+  MC_FIELD(foc_hfi_start_samples, CONF_FIELD_UINT16),
+  MC_FIELD(m_fault_stop_time_ms, CONF_FIELD_INT32),
+  MC_FIELD(m_encoder_counts, CONF_FIELD_UINT32),
+  MC_FIELD(l_current_min, CONF_FIELD_FLOAT32_AUTO),
+};
+
+const std::vector<VescConfField> APP_TEST_FIELDS = {
+  APP_FIELD(imu_conf.sample_rate_hz, CONF_FIELD_INT_U16),
+  APP_FIELD(send_can_status_rate_hz, CONF_FIELD_UINT32_U16),
+};
+
+#undef APP_FIELD
+#undef MC_FIELD
+
+const uint32_t TEST_SIGNATURE = 0x12345678;
+
+/** Serialized MC_TEST_FIELDS, with the sign bits set where the field has one. */
+const std::vector<uint8_t> MC_TEST_DATA = {
+  0x02,                     // pwm_mode
+  0x42, 0x70, 0x00, 0x00,   // l_current_max, 60.0 as float32_auto
+  0x01,                     // l_slow_abs_current
+  0xFF,                     // hall_table[0], -1
+  0xC8,                     // foc_hall_table[0], 200
+  0x0A,                     // m_drv8301_oc_adj
+  0xFC, 0x18,               // gpd_buffer_notify_left, -1000
+  0xEA, 0x60,               // foc_hfi_start_samples, 60000
+  0xFF, 0xFF, 0xFE, 0x0C,   // m_fault_stop_time_ms, -500
+  0x80, 0x00, 0x00, 0x01,   // m_encoder_counts, 2^31 + 1
+  0xC2, 0x70, 0x00, 0x00,   // l_current_min, -60.0
+};
+
+}  // namespace
+
+TEST(VescConfCodec, RegisteredMcConfCodecsMatchCapturedReplies)
+{
+  checkCaptures(vesc_driver::mcConfCodecs(), "mcconf");
+}
+
+TEST(VescConfCodec, RegisteredAppConfCodecsMatchCapturedReplies)
+{
+  checkCaptures(vesc_driver::appConfCodecs(), "appconf");
+}
+
+TEST(VescConfCodec, LookupFindsOnlyRegisteredReleases)
+{
+  for (const auto & codec : vesc_driver::mcConfCodecs()) {
+    EXPECT_EQ(vesc_driver::mcConfCodec(codec.fwMajor(), codec.fwMinor()), &codec);
+  }
+  for (const auto & codec : vesc_driver::appConfCodecs()) {
+    EXPECT_EQ(vesc_driver::appConfCodec(codec.fwMajor(), codec.fwMinor()), &codec);
+  }
+  EXPECT_EQ(vesc_driver::mcConfCodec(0, 0), nullptr);
+  EXPECT_EQ(vesc_driver::appConfCodec(0, 0), nullptr);
+}
+
+TEST(VescConfCodec, DecodesEveryFieldTypeAndEncodesItBack)
+{
+  const VescConfCodec<mc_configuration> codec(1, 0, TEST_SIGNATURE, MC_TEST_FIELDS);
+  ASSERT_EQ(codec.size(), MC_TEST_DATA.size());
+
+  mc_configuration conf = mc_configuration();
+  ASSERT_TRUE(codec.decode(TEST_SIGNATURE, MC_TEST_DATA.data(), MC_TEST_DATA.size(), &conf));
+  EXPECT_EQ(conf.pwm_mode, 2);
+  EXPECT_EQ(conf.l_current_max, 60.0f);
+  EXPECT_TRUE(conf.l_slow_abs_current);
+  EXPECT_EQ(conf.hall_table[0], -1);
+  EXPECT_EQ(conf.foc_hall_table[0], 200);
+  EXPECT_EQ(conf.m_drv8301_oc_adj, 10);
+  EXPECT_EQ(conf.gpd_buffer_notify_left, -1000);
+  EXPECT_EQ(conf.foc_hfi_start_samples, 60000);
+  EXPECT_EQ(conf.m_fault_stop_time_ms, -500);
+  EXPECT_EQ(conf.m_encoder_counts, 0x80000001u);
+  EXPECT_EQ(conf.l_current_min, -60.0f);
+
+  std::vector<uint8_t> encoded(codec.size());
+  codec.encode(conf, encoded.data());
+  EXPECT_EQ(encoded, MC_TEST_DATA);
+}
+
+TEST(VescConfCodec, EncodesFloatsThatDecodeBackExactly)
+{
+  const std::vector<VescConfField> fields = {MC_TEST_FIELDS[1]};
+  const VescConfCodec<mc_configuration> codec(1, 0, TEST_SIGNATURE, fields);
+  const auto encoded = [&codec](float value) {
+      mc_configuration conf = mc_configuration();
+      conf.l_current_max = value;
+      uint8_t data[4];
+      codec.encode(conf, data);
+      return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+             (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+    };
+
+  const std::vector<float> edges = {
+    0.0f, 1.0f, -1.0f, 0.5f, 60.0f, -60.0f, 0.02f, 1e-30f, -1e30f, 1.5e-38f, -1.5e-38f,
+    std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+  for (float value : edges) {
+    EXPECT_EQ(vesc_driver::decodeFloat32Auto(encoded(value)), value) << value;
+  }
+
+  // every finite float from 1.5e-38 on survives, the layout keeps all 24 significant bits
+  std::mt19937 rng(1);
+  for (int i = 0; i < 100000; i++) {
+    uint32_t bits = static_cast<uint32_t>(rng());
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    if (!std::isfinite(value) || std::fabs(value) < 1.5e-38f) {
+      continue;
+    }
+    ASSERT_EQ(vesc_driver::decodeFloat32Auto(encoded(value)), value) << std::hex << bits;
+  }
+
+  // smaller values are flushed to zero like the firmware does, they would alias the scaled zero
+  // exponent
+  EXPECT_EQ(encoded(std::numeric_limits<float>::min()), 0u);
+  EXPECT_EQ(encoded(-std::numeric_limits<float>::denorm_min()), 0u);
+  EXPECT_EQ(encoded(-0.0f), 0u);
+}
+
+TEST(VescConfCodec, DecodesUnsigned16BitIntoWiderFields)
+{
+  const VescConfCodec<app_configuration> codec(1, 0, TEST_SIGNATURE, APP_TEST_FIELDS);
+  const std::vector<uint8_t> data = {0xFD, 0xE8, 0xFF, 0xFF};
+
+  app_configuration conf = app_configuration();
+  ASSERT_TRUE(codec.decode(TEST_SIGNATURE, data.data(), data.size(), &conf));
+  EXPECT_EQ(conf.imu_conf.sample_rate_hz, 65000);
+  EXPECT_EQ(conf.send_can_status_rate_hz, 65535u);
+
+  std::vector<uint8_t> encoded(codec.size());
+  codec.encode(conf, encoded.data());
+  EXPECT_EQ(encoded, data);
+}
+
+TEST(VescConfCodec, RejectsOtherSignatureOrSize)
+{
+  const VescConfCodec<mc_configuration> codec(1, 0, TEST_SIGNATURE, MC_TEST_FIELDS);
+  mc_configuration conf = mc_configuration();
+  conf.l_current_max = 1.0f;
+
+  EXPECT_FALSE(
+    codec.decode(TEST_SIGNATURE + 1, MC_TEST_DATA.data(), MC_TEST_DATA.size(), &conf));
+  EXPECT_FALSE(
+    codec.decode(TEST_SIGNATURE, MC_TEST_DATA.data(), MC_TEST_DATA.size() - 1, &conf));
+  EXPECT_EQ(conf.l_current_max, 1.0f);
+}
+
+TEST(VescConfCodec, CaptureFileRoundTrips)
+{
+  VescConfBlob blob;
+  blob.fw_major = 5;
+  blob.fw_minor = 2;
+  blob.signature = TEST_SIGNATURE;
+  blob.data = MC_TEST_DATA;
+  const std::string path = testing::TempDir() + "test_vesc_configuration.mcconf";
+  vesc_driver::storeConfBlob(path, blob);
+
+  VescConfBlob loaded;
+  ASSERT_TRUE(vesc_driver::loadConfBlob(path, &loaded));
+  EXPECT_EQ(loaded.fw_major, 5);
+  EXPECT_EQ(loaded.fw_minor, 2);
+  EXPECT_EQ(loaded.signature, TEST_SIGNATURE);
+  EXPECT_EQ(loaded.data, MC_TEST_DATA);
+  std::remove(path.c_str());
+
+  EXPECT_FALSE(vesc_driver::loadConfBlob(path, &loaded));
+}
@@ -0,0 +1,193 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "vesc_driver/vesc_float_decode.hpp"
+
+using vesc_driver::decodeFloat32Auto;
+using vesc_driver::decodeFloat32AutoBlock;
+
+namespace
+{
+
+/** buffer_get_float32_auto() of the VESC firmware, the decoder both must match bit for bit. */
+float firmwareDecode(uint32_t bits)
+{
+  int e = (bits >> 23) & 0xFF;
+  const uint32_t sig_i = bits & 0x7FFFFF;
+  const bool neg_i = bits & (1u << 31);
+
+  float sig = 0.0f;
+  if (e != 0 || sig_i != 0) {
+    sig = static_cast<float>(sig_i) / (8388608.0f * 2.0f) + 0.5f;
+    e -= 126;
+  }
+  if (neg_i) {
+    sig = -sig;
+  }
+  return ldexpf(sig, e);
+}
+
+uint32_t toBits(float value)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+void appendBigEndian(uint32_t bits, std::vector<uint8_t> * data)
+{
+  data->push_back(static_cast<uint8_t>(bits >> 24));
+  data->push_back(static_cast<uint8_t>(bits >> 16));
+  data->push_back(static_cast<uint8_t>(bits >> 8));
+  data->push_back(static_cast<uint8_t>(bits));
+}
+
+/**
+ * Decodes @p values with the block decoder, from a buffer starting @p misalignment bytes into
+ * an allocation so unaligned loads are covered, and compares each with the firmware.
+ */
+void expectBlockMatches(const std::vector<uint32_t> & values, std::size_t misalignment)
+{
+  std::vector<uint8_t> data(misalignment);
+  for (uint32_t bits : values) {
+    appendBigEndian(bits, &data);
+  }
+  std::vector<float> out(values.size() + 1, 0.0f);
+  const float canary = out.back();
+  decodeFloat32AutoBlock(data.data() + misalignment, values.size(), out.data());
+  for (std::size_t i = 0; i < values.size(); i++) {
+    ASSERT_EQ(toBits(out[i]), toBits(firmwareDecode(values[i])))
+      << "value " << i << " of " << values.size() << ", bits 0x" << std::hex << values[i];
+  }
+  EXPECT_EQ(toBits(out.back()), toBits(canary)) << "wrote past the block";
+}
+
+/** Zero, both signs, subnormals and the edge exponents 0, 1, 254 and 255. */
+const uint32_t EDGE_VALUES[] = {
+  0x00000000u, 0x80000000u,
+  0x00000001u, 0x00000002u, 0x00000003u, 0x00400000u, 0x00400001u, 0x007FFFFFu,
+  0x80000001u, 0x80000003u, 0x807FFFFEu, 0x807FFFFFu,
+  0x00800000u, 0x00800001u, 0x00FFFFFFu, 0x80800000u, 0x80FFFFFFu,
+  0x7F000000u, 0x7F000001u, 0x7F7FFFFFu, 0xFF000000u, 0xFF7FFFFFu,
+  0x7F800000u, 0x7F800001u, 0x7FC00000u, 0x7FFFFFFFu, 0xFF800000u, 0xFFFFFFFFu,
+  0x3F800000u, 0xBF800000u, 0x3EAAAAABu,
+};
+
+/**
+ * Skips the tests if the decoder under test was built for an instruction set, given by
+ * VESC_FLOAT_DECODE_TEST_ISA, that this CPU does not have.
+ */
+class VescFloatDecode : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+#if defined(VESC_FLOAT_DECODE_TEST_ISA)
+    if (!__builtin_cpu_supports(VESC_FLOAT_DECODE_TEST_ISA)) {
+      GTEST_SKIP() << "CPU lacks " << VESC_FLOAT_DECODE_TEST_ISA;
+    }
+#endif
+  }
+};
+
+}  // namespace
+
+TEST_F(VescFloatDecode, ScalarMatchesFirmwareOnEdgeValues)
+{
+  for (uint32_t bits : EDGE_VALUES) {
+    EXPECT_EQ(toBits(decodeFloat32Auto(bits)), toBits(firmwareDecode(bits)))
+      << "bits 0x" << std::hex << bits;
+  }
+}
+
+TEST_F(VescFloatDecode, ScalarMatchesFirmwareOnEveryExponent)
+{
+  const uint32_t fractions[] = {0x000000u, 0x000001u, 0x000002u, 0x000003u, 0x3FFFFFu,
+    0x400000u, 0x400001u, 0x7FFFFEu, 0x7FFFFFu};
+  for (uint32_t sign = 0; sign < 2; sign++) {
+    for (uint32_t exponent = 0; exponent < 256; exponent++) {
+      for (uint32_t fraction : fractions) {
+        const uint32_t bits = (sign << 31) | (exponent << 23) | fraction;
+        ASSERT_EQ(toBits(decodeFloat32Auto(bits)), toBits(firmwareDecode(bits)))
+          << "bits 0x" << std::hex << bits;
+      }
+    }
+  }
+}
+
+TEST_F(VescFloatDecode, BlockMatchesFirmwareWithEdgeValueInEveryLane)
+{
+  // lengths past two AVX2 vectors, so every value lands in each vector lane and in the remainder
+  const uint32_t filler = 0x3F800000u;
+  for (uint32_t bits : EDGE_VALUES) {
+    for (std::size_t length = 1; length <= 19; length++) {
+      for (std::size_t lane = 0; lane < length; lane++) {
+        std::vector<uint32_t> values(length, filler);
+        values[lane] = bits;
+        expectBlockMatches(values, 0);
+      }
+    }
+  }
+}
+
+TEST_F(VescFloatDecode, BlockMatchesFirmwareOnRandomBlocks)
+{
+  std::mt19937 rng(20240617);
+  for (std::size_t length = 0; length <= 67; length++) {
+    for (std::size_t misalignment = 0; misalignment < 4; misalignment++) {
+      std::vector<uint32_t> values(length);
+      for (auto & bits : values) {
+        bits = static_cast<uint32_t>(rng());
+        // a quarter of the values get a zero or reserved exponent, which take the patch-up path
+        switch (rng() % 8) {
+          case 0: bits &= ~0x7F800000u; break;
+          case 1: bits |= 0x7F800000u; break;
+          default: break;
+        }
+      }
+      expectBlockMatches(values, misalignment);
+    }
+  }
+}
+
+TEST_F(VescFloatDecode, BlockOfZeroLengthWritesNothing)
+{
+  float out = 1.0f;
+  decodeFloat32AutoBlock(NULL, 0, &out);
+  EXPECT_EQ(out, 1.0f);
+}
@@ -0,0 +1,233 @@
+// Copyright 2020 F1TENTH Foundation
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+//   * Neither the name of the {copyright_holder} nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// -*- mode:c++; fill-column: 100; -*-
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vesc_driver/datatypes.hpp"
+#include "vesc_driver/vesc_framer.hpp"
+#include "vesc_driver/vesc_packet.hpp"
+
+using vesc_driver::Buffer;
+using vesc_driver::VescFrame;
+using vesc_driver::VescFramer;
+using vesc_driver::VescPacketConstPtr;
+
+namespace
+{
+
+/** A frame with @p payload_size bytes of payload, a large frame from 256 bytes on. */
+Buffer makeFrame(uint8_t payload_id, std::size_t payload_size, std::mt19937 & rng)
+{
+  Buffer payload(payload_size);
+  payload[0] = payload_id;
+  for (std::size_t i = 1; i < payload.size(); i++) {
+    payload[i] = static_cast<uint8_t>(rng());
+  }
+
+  Buffer frame;
+  if (payload_size < 256) {
+    frame.push_back(VescFrame::VESC_SOF_VAL_SMALL_FRAME);
+  } else {
+    frame.push_back(VescFrame::VESC_SOF_VAL_LARGE_FRAME);
+    frame.push_back(static_cast<uint8_t>(payload_size >> 8));
+  }
+  frame.push_back(static_cast<uint8_t>(payload_size & 0xFF));
+  frame.insert(frame.end(), payload.begin(), payload.end());
+  uint16_t crc = CRC::Calculate(payload.data(), payload.size(), VescFrame::CRC_TYPE);
+  frame.push_back(static_cast<uint8_t>(crc >> 8));
+  frame.push_back(static_cast<uint8_t>(crc & 0xFF));
+  frame.push_back(VescFrame::VESC_EOF_VAL);
+  return frame;
+}
+
+/** Values, McConf (large) and SetMcConf acknowledgement frames, in random order. */
+Buffer makeFrame(std::mt19937 & rng)
+{
+  switch (rng() % 3) {
+    case 0:
+      return makeFrame(vesc_driver::COMM_GET_VALUES, 74, rng);
+    case 1:
+      return makeFrame(vesc_driver::COMM_GET_MCCONF, 438, rng);
+    default:
+      return makeFrame(vesc_driver::COMM_SET_MCCONF, 1, rng);
+  }
+}
+
+/**
+ * Start-of-frame characters and bytes that are not a registered payload id, so noise on its own can
+ * never form a valid packet but keeps the framer busy with candidates and bogus lengths.
+ */
+uint8_t noiseByte(std::mt19937 & rng)
+{
+  switch (rng() % 3) {
+    case 0:
+      return VescFrame::VESC_SOF_VAL_SMALL_FRAME;
+    case 1:
+      return VescFrame::VESC_SOF_VAL_LARGE_FRAME;
+    default:
+      return static_cast<uint8_t>(0x80 | rng());
+  }
+}
+
+/** Compares frame by frame, which keeps failure messages readable. */
+void expectFrames(
+  const std::vector<Buffer> & expected, const std::vector<Buffer> & actual, const char * what)
+{
+  EXPECT_EQ(expected.size(), actual.size()) << what;
+  for (std::size_t i = 0; i < std::min(expected.size(), actual.size()); i++) {
+    if (expected[i] != actual[i]) {
+      ADD_FAILURE() << what << ": frame " << i << " differs, " << expected[i].size() <<
+        " bytes expected, " << actual[i].size() << " received";
+      return;
+    }
+  }
+}
+
+/** Pushes @p stream in random chunks of up to @p max_chunk bytes, returns the frames received. */
+std::vector<Buffer> frame(const Buffer & stream, std::size_t max_chunk, std::mt19937 & rng)
+{
+  std::vector<Buffer> frames;
+  VescFramer framer([&frames](const VescPacketConstPtr & packet) {
+      frames.push_back(packet->frame());
+    });
+  std::size_t pos = 0;
+  while (pos < stream.size()) {
+    std::size_t chunk = std::min<std::size_t>(1 + rng() % max_chunk, stream.size() - pos);
+    framer.push(stream.data() + pos, chunk);
+    pos += chunk;
+  }
+  EXPECT_LT(framer.buffered(), static_cast<std::size_t>(VescFrame::VESC_MAX_FRAME_SIZE));
+  return frames;
+}
+
+}  // namespace
+
+TEST(VescFramer, SplitsCleanStreamAtAnyBoundary)
+{
+  std::mt19937 rng(1);
+  std::vector<Buffer> sent;
+  Buffer stream;
+  for (int i = 0; i < 50; i++) {
+    sent.push_back(makeFrame(rng));
+    stream.insert(stream.end(), sent.back().begin(), sent.back().end());
+  }
+
+  for (std::size_t max_chunk : {1, 2, 7, 64, 4096}) {
+    expectFrames(sent, frame(stream, max_chunk, rng), "clean stream");
+  }
+}
+
+TEST(VescFramer, DoesNotWaitOnBogusLength)
+{
+  std::mt19937 rng(2);
+  const Buffer good = makeFrame(vesc_driver::COMM_SET_MCCONF, 1, rng);
+
+  int packets = 0;
+  VescFramer framer([&packets](const VescPacketConstPtr &) {packets++;});
+  // a large frame header announcing 1000 bytes, followed by a complete frame
+  const Buffer bogus = {VescFrame::VESC_SOF_VAL_LARGE_FRAME, 0x03, 0xE8, 0x01, 0x02};
+  framer.push(bogus.data(), bogus.size());
+  framer.push(good.data(), good.size());
+  EXPECT_EQ(1, packets);
+  EXPECT_EQ(0u, framer.buffered());
+}
+
+TEST(VescFramer, RecoversFromCorruptedAndTruncatedFrames)
+{
+  std::mt19937 rng(3);
+  for (int round = 0; round < 20; round++) {
+    std::vector<Buffer> intact;
+    Buffer stream;
+    for (int i = 0; i < 200; i++) {
+      Buffer f = makeFrame(rng);
+      switch (rng() % 6) {
+        case 0:
+          // truncated before its checksum, e.g. the VESC was reset mid-frame. Losing only the
+          // end-of-frame byte is not detectable when the next start-of-frame byte supplies it.
+          f.resize(1 + rng() % (f.size() - 3));
+          break;
+        case 1:
+          // one corrupted byte
+          f[rng() % f.size()] ^= static_cast<uint8_t>(1 + rng() % 255);
+          break;
+        case 2:
+          {
+            // noise before the frame
+            Buffer noise(rng() % 64);
+            for (auto & b : noise) {
+              b = noiseByte(rng);
+            }
+            stream.insert(stream.end(), noise.begin(), noise.end());
+            intact.push_back(f);
+          }
+          break;
+        default:
+          intact.push_back(f);
+          break;
+      }
+      stream.insert(stream.end(), f.begin(), f.end());
+    }
+    // a final good frame flushes anything held back by a bogus length
+    intact.push_back(makeFrame(vesc_driver::COMM_SET_MCCONF, 1, rng));
+    stream.insert(stream.end(), intact.back().begin(), intact.back().end());
+
+    SCOPED_TRACE("round " + std::to_string(round));
+    expectFrames(intact, frame(stream, stream.size(), rng), "whole stream");
+    // how the stream is split must not change the result
+    expectFrames(intact, frame(stream, 1, rng), "byte by byte");
+    expectFrames(intact, frame(stream, 17, rng), "17 byte chunks");
+  }
+}
+
+TEST(VescFramer, StressNoiseByteByByte)
+{
+  // candidates with long, unverified lengths pushed a byte at a time, which made every push
+  // examine all buffered candidates again before the search was resumable
+  std::mt19937 rng(4);
+  Buffer noise(1 << 18);
+  for (auto & b : noise) {
+    b = noiseByte(rng);
+  }
+
+  int packets = 0;
+  VescFramer framer([&packets](const VescPacketConstPtr &) {packets++;});
+  for (uint8_t b : noise) {
+    framer.push(&b, 1);
+    ASSERT_LE(framer.buffered(), static_cast<std::size_t>(VescFrame::VESC_MAX_FRAME_SIZE));
+  }
+  EXPECT_EQ(0, packets);
+}